@@ -4,6 +4,14 @@
 #include "round.h"	// 		#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>	
+#include <string.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#define BITMAP_SIMD 1
+/* The SIMD kernels are optimized even in -O0 builds, where the
+   intrinsics would otherwise not be inlined. */
+#define KERNEL(ISA) __attribute__ ((target (ISA), optimize ("O2")))
+#endif
 
 
 #include "hex_dump.h"	
@@ -24,11 +32,14 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.  The unused bits of the last
+   element are kept zero, so that whole elements can be combined
+   and compared. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    size_t elem_cap;    /* Number of elements allocated in BITS. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -61,6 +72,30 @@ byte_cnt (size_t bit_cnt)
   return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns a mask of the bits of an element numbered START_IDX
+   and up, that is, of the range's first element. */
+static inline elem_type
+first_mask (size_t start_idx)
+{
+  return (elem_type) -1 << (start_idx % ELEM_BITS);
+}
+
+/* Returns a mask of the bits of an element numbered END_IDX - 1
+   and down, that is, of the last element of a range ending at
+   END_IDX (exclusive). */
+static inline elem_type
+end_mask (size_t end_idx)
+{
+  return (elem_type) -1 >> (ELEM_BITS - 1 - (end_idx - 1) % ELEM_BITS);
+}
+
+/* Returns the number of bits set in element E. */
+static inline size_t
+elem_popcount (elem_type e)
+{
+  return __builtin_popcountl (e);
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -70,6 +105,166 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Bulk operations on arrays of elements.
+
+   Each exists as plain C, with SSE2 (and hardware popcnt), and
+   with AVX2 intrinsics; the best one the CPU supports is picked
+   on first use.  The environment variable BITMAP_SIMD set to
+   "scalar" or "sse2" caps the choice, to compare them. */
+
+/* DST[i] = DST[i] op SRC[i] for I < N. */
+typedef void elem_op_func (elem_type *dst, const elem_type *src, size_t n);
+
+/* Returns the number of bits set in the N elements of A. */
+typedef size_t elem_popcount_func (const elem_type *a, size_t n);
+
+struct bitmap_kernels
+  {
+    const char *name;
+    elem_op_func *and, *or, *xor, *andnot;
+    elem_popcount_func *popcount;
+  };
+
+/* Defines NAME_scalar, NAME_sse2 and NAME_avx2, applying
+   SCALAR_OP, SSE2_OP or AVX2_OP (an intrinsic) to D and S. */
+#define SCALAR_KERNEL(NAME, SCALAR_OP)                                  \
+static void                                                             \
+NAME##_scalar (elem_type *d, const elem_type *s, size_t n)              \
+{                                                                       \
+  size_t i;                                                             \
+  for (i = 0; i < n; i++)                                               \
+    d[i] = SCALAR_OP (d[i], s[i]);                                      \
+}
+#ifdef BITMAP_SIMD
+#define ELEM_KERNEL(NAME, SCALAR_OP, SSE2_OP, AVX2_OP)                  \
+SCALAR_KERNEL (NAME, SCALAR_OP)                                         \
+KERNEL ("sse2") static void                                             \
+NAME##_sse2 (elem_type *d, const elem_type *s, size_t n)                \
+{                                                                       \
+  size_t i, per = sizeof (__m128i) / sizeof (elem_type);                \
+  for (i = 0; i + per <= n; i += per)                                   \
+    {                                                                   \
+      __m128i x = _mm_loadu_si128 ((const __m128i *) (d + i));          \
+      __m128i y = _mm_loadu_si128 ((const __m128i *) (s + i));          \
+      _mm_storeu_si128 ((__m128i *) (d + i), SSE2_OP (x, y));           \
+    }                                                                   \
+  NAME##_scalar (d + i, s + i, n - i);                                  \
+}                                                                       \
+KERNEL ("avx2") static void                                             \
+NAME##_avx2 (elem_type *d, const elem_type *s, size_t n)                \
+{                                                                       \
+  size_t i, per = sizeof (__m256i) / sizeof (elem_type);                \
+  for (i = 0; i + per <= n; i += per)                                   \
+    {                                                                   \
+      __m256i x = _mm256_loadu_si256 ((const __m256i *) (d + i));       \
+      __m256i y = _mm256_loadu_si256 ((const __m256i *) (s + i));       \
+      _mm256_storeu_si256 ((__m256i *) (d + i), AVX2_OP (x, y));        \
+    }                                                                   \
+  NAME##_scalar (d + i, s + i, n - i);                                  \
+}
+#else
+#define ELEM_KERNEL(NAME, SCALAR_OP, SSE2_OP, AVX2_OP)                  \
+SCALAR_KERNEL (NAME, SCALAR_OP)
+#endif
+
+#define AND(X, Y) ((X) & (Y))
+#define OR(X, Y) ((X) | (Y))
+#define XOR(X, Y) ((X) ^ (Y))
+#define ANDNOT(X, Y) ((X) & ~(Y))
+/* The andnot intrinsics compute ~first & second. */
+#define SSE2_ANDNOT(X, Y) _mm_andnot_si128 (Y, X)
+#define AVX2_ANDNOT(X, Y) _mm256_andnot_si256 (Y, X)
+
+ELEM_KERNEL (and, AND, _mm_and_si128, _mm256_and_si256)
+ELEM_KERNEL (or, OR, _mm_or_si128, _mm256_or_si256)
+ELEM_KERNEL (xor, XOR, _mm_xor_si128, _mm256_xor_si256)
+ELEM_KERNEL (andnot, ANDNOT, SSE2_ANDNOT, AVX2_ANDNOT)
+
+static size_t
+popcount_scalar (const elem_type *a, size_t n)
+{
+  size_t i, ones = 0;
+  for (i = 0; i < n; i++)
+    ones += __builtin_popcountl (a[i]);
+  return ones;
+}
+
+#ifdef BITMAP_SIMD
+/* Same loop, but compiled to the popcnt instruction. */
+KERNEL ("popcnt") static size_t
+popcount_sse2 (const elem_type *a, size_t n)
+{
+  size_t i, ones = 0;
+  for (i = 0; i < n; i++)
+    ones += __builtin_popcountl (a[i]);
+  return ones;
+}
+
+/* Counts 32 bytes at a time: vpshufb looks up the bit count of
+   each nibble in a 16-entry table, and vpsadbw sums the byte
+   counts into four 64-bit lanes. */
+KERNEL ("avx2,popcnt") static size_t
+popcount_avx2 (const elem_type *a, size_t n)
+{
+  const __m256i table = _mm256_setr_epi8 (0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8 (0x0f);
+  __m256i sum = _mm256_setzero_si256 ();
+  size_t i, per = sizeof (__m256i) / sizeof (elem_type), ones;
+
+  for (i = 0; i + per <= n; i += per)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) (a + i));
+      __m256i cnt = _mm256_add_epi8 (
+        _mm256_shuffle_epi8 (table, _mm256_and_si256 (v, low)),
+        _mm256_shuffle_epi8 (table,
+                             _mm256_and_si256 (_mm256_srli_epi16 (v, 4), low)));
+      sum = _mm256_add_epi64 (sum, _mm256_sad_epu8 (cnt, _mm256_setzero_si256 ()));
+    }
+  ones = _mm256_extract_epi64 (sum, 0) + _mm256_extract_epi64 (sum, 1)
+         + _mm256_extract_epi64 (sum, 2) + _mm256_extract_epi64 (sum, 3);
+  return ones + popcount_sse2 (a + i, n - i);
+}
+#endif
+
+static const struct bitmap_kernels scalar_kernels =
+  { "scalar", and_scalar, or_scalar, xor_scalar, andnot_scalar, popcount_scalar };
+#ifdef BITMAP_SIMD
+static const struct bitmap_kernels sse2_kernels =
+  { "sse2", and_sse2, or_sse2, xor_sse2, andnot_sse2, popcount_sse2 };
+static const struct bitmap_kernels avx2_kernels =
+  { "avx2", and_avx2, or_avx2, xor_avx2, andnot_avx2, popcount_avx2 };
+#endif
+
+/* Returns the kernels for this CPU, choosing them on the first
+   call. */
+static const struct bitmap_kernels *
+select_kernels (void)
+{
+  static const struct bitmap_kernels *kernels;
+
+  if (kernels == NULL)
+    {
+      const char *cap = getenv ("BITMAP_SIMD");
+
+      kernels = &scalar_kernels;
+#ifdef BITMAP_SIMD
+      if (cap == NULL || strcmp (cap, "scalar") != 0)
+        {
+          __builtin_cpu_init ();
+          if (__builtin_cpu_supports ("popcnt"))
+            kernels = &sse2_kernels;
+          if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("popcnt")
+              && (cap == NULL || strcmp (cap, "sse2") != 0))
+            kernels = &avx2_kernels;
+        }
+#endif
+    }
+  return kernels;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -84,9 +279,10 @@ bitmap_create (size_t bit_cnt)
     {
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
+      b->elem_cap = elem_cnt (bit_cnt);
       if (b->bits != NULL || bit_cnt == 0)
         {
-          bitmap_set_all (b, false);
+          memset (b->bits, 0, byte_cnt (bit_cnt));
           return b;
         }
       free (b);
@@ -107,7 +303,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size )
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
-  bitmap_set_all (b, false);
+  b->elem_cap = elem_cnt (bit_cnt);
+  memset (b->bits, 0, byte_cnt (bit_cnt));
   return b;
 }
 
@@ -165,7 +362,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
   /* This is equivalent to `b->bits[idx] |= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %k1, %k0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  asm ("or %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -178,7 +375,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
   /* This is equivalent to `b->bits[idx] &= ~mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %k1, %k0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  asm ("and %1, %0" : "+m" (b->bits[idx]) : "r" (~mask) : "cc");
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -193,7 +390,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
   /* This is equivalent to `b->bits[idx] ^= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
-  asm ("xorl %k1, %k0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  asm ("xor %1, %0" : "+m" (b->bits[idx]) : "r" (mask) : "cc");
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -216,36 +413,133 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Whole elements are written at once; only the first and last
+   are masked. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t first, last, i;
+  elem_type mask, fill = value ? (elem_type) -1 : 0;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  if (cnt == 0)
+    return;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  for (i = first; i <= last; i++)
+    {
+      mask = (elem_type) -1;
+      if (i == first)
+        mask &= first_mask (start);
+      if (i == last)
+        mask &= end_mask (start + cnt);
+      b->bits[i] = (b->bits[i] & ~mask) | (fill & mask);
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
-   exclusive, that are set to VALUE. */
+   exclusive, that are set to VALUE.  Counts a whole element at a
+   time with popcount. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t first, last, ones;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  if (cnt == 0)
+    return 0;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  if (first == last)
+    ones = elem_popcount (b->bits[first] & first_mask (start)
+                          & end_mask (start + cnt));
+  else
+    {
+      ones = elem_popcount (b->bits[first] & first_mask (start));
+      ones += select_kernels ()->popcount (b->bits + first + 1, last - first - 1);
+      ones += elem_popcount (b->bits[last] & end_mask (start + cnt));
+    }
+  return value ? ones : cnt - ones;
+}
+
+/* Returns the index of the first bit at or after START in B that
+   is set to VALUE, or B's size if there is none.  Skips a whole
+   element at a time and finds the bit in it with ctz. */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx, cnt = elem_cnt (b->bit_cnt);
+  elem_type e;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+  idx = elem_idx (start);
+  e = (b->bits[idx] ^ flip) & first_mask (start);
+  while (e == 0)
+    {
+      if (++idx >= cnt)
+        return b->bit_cnt;
+      e = b->bits[idx] ^ flip;
+    }
+
+  /* The unused bits of the last element may be anything. */
+  start = idx * ELEM_BITS + __builtin_ctzl (e);
+  return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
+/* Returns the index of the first bit at or after START in B that
+   begins a run of at least CNT bits set to VALUE, where 1 <= CNT
+   <= ELEM_BITS, or B's size if there is none.
+
+   Works on a window of two elements: ANDing the window with
+   itself shifted right by 1, 2, 4, ... bits leaves bit P set
+   only if bits P through P + CNT - 1 all were, so each element
+   costs O(log CNT) word operations whatever the bit pattern. */
+static size_t
+find_run (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx, last = elem_cnt (b->bit_cnt) - 1;
+  elem_type cur, next;
+
+  ASSERT (cnt >= 1 && cnt <= ELEM_BITS);
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  idx = elem_idx (start);
+  cur = (b->bits[idx] ^ flip) & (idx == last ? last_mask (b) : (elem_type) -1)
+        & first_mask (start);
+  for (; idx <= last; idx++, cur = next)
+    {
+      elem_type lo = cur, hi;
+      size_t len, step;
+
+      next = 0;
+      if (idx + 1 < last)
+        next = b->bits[idx + 1] ^ flip;
+      else if (idx + 1 == last)
+        next = (b->bits[last] ^ flip) & last_mask (b);
+
+      hi = next;
+      for (len = 1; len < cnt; len += step)
+        {
+          step = len < cnt - len ? len : cnt - len;
+          /* Shift the LO:HI window right by STEP < ELEM_BITS. */
+          lo &= lo >> step | hi << (ELEM_BITS - step);
+          hi &= hi >> step;
+        }
+      if (lo != 0)
+        return idx * ELEM_BITS + __builtin_ctzl (lo);
+    }
+  return b->bit_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -253,16 +547,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && find_next (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -289,27 +578,110 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
   return !bitmap_contains (b, start, cnt, false);
 }
 
+/* Set operations on whole bitmaps. */
+
+/* Applies OP to DST and SRC element by element, over the bits
+   they have in common.  SRC's unused bits are zero, so it acts
+   as if padded with false bits; DST's unused bits are cleared
+   again afterward. */
+static void
+combine (struct bitmap *dst, const struct bitmap *src, elem_op_func *op)
+{
+  size_t n;
+
+  ASSERT (dst != NULL);
+  ASSERT (src != NULL);
+
+  n = elem_cnt (dst->bit_cnt < src->bit_cnt ? dst->bit_cnt : src->bit_cnt);
+  op (dst->bits, src->bits, n);
+  if (dst->bit_cnt > 0)
+    dst->bits[elem_cnt (dst->bit_cnt) - 1] &= last_mask (dst);
+}
+
+/* Sets DST to DST & SRC.  Bits of DST past the end of SRC are
+   cleared. */
+void
+bitmap_and (struct bitmap *dst, const struct bitmap *src)
+{
+  size_t n = elem_cnt (src->bit_cnt);
+
+  combine (dst, src, select_kernels ()->and);
+  if (elem_cnt (dst->bit_cnt) > n)
+    memset (dst->bits + n, 0, (elem_cnt (dst->bit_cnt) - n) * sizeof (elem_type));
+}
+
+/* Sets DST to DST | SRC.  Bits of SRC past the end of DST are
+   ignored. */
+void
+bitmap_or (struct bitmap *dst, const struct bitmap *src)
+{
+  combine (dst, src, select_kernels ()->or);
+}
+
+/* Sets DST to DST ^ SRC.  Bits of SRC past the end of DST are
+   ignored. */
+void
+bitmap_xor (struct bitmap *dst, const struct bitmap *src)
+{
+  combine (dst, src, select_kernels ()->xor);
+}
+
+/* Sets DST to DST & ~SRC, that is, removes the members of SRC
+   from DST. */
+void
+bitmap_andnot (struct bitmap *dst, const struct bitmap *src)
+{
+  combine (dst, src, select_kernels ()->andnot);
+}
+
+/* Returns true if A and B have the same size and bits.  memcmp()
+   is already vectorized by the C library. */
+bool
+bitmap_equal (const struct bitmap *a, const struct bitmap *b)
+{
+  ASSERT (a != NULL);
+  ASSERT (b != NULL);
+
+  return a->bit_cnt == b->bit_cnt
+         && (a->bit_cnt == 0
+             || memcmp (a->bits, b->bits, byte_cnt (a->bit_cnt)) == 0);
+}
+
 /* Finding set or unset bits. */
 
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Searches a whole element at a time with find_run().  For CNT
+   above ELEM_BITS that only finds runs at least ELEM_BITS long,
+   so each candidate's end is then looked up and, if the run is
+   too short, the search goes on after it; there are at most
+   bit_cnt / ELEM_BITS such candidates. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t i, end, run_cnt = cnt < ELEM_BITS ? cnt : ELEM_BITS;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt > b->bit_cnt || start > b->bit_cnt - cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+  for (i = start; ; i = end)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      i = find_run (b, i, run_cnt, value);
+      if (i > b->bit_cnt - cnt)
+        return BITMAP_ERROR;
+      if (cnt == run_cnt)
+        return i;
+      end = find_next (b, i, !value);
+      if (end - i >= cnt)
+        return i;
     }
-  return BITMAP_ERROR;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -344,19 +716,28 @@ bitmap_dump (const struct bitmap *b)
   hex_dump (0, b->bits, byte_cnt (b->bit_cnt)/2, false);
 }
 
-/* creates a new bitmap with size expanded, and returns the pointer to it. returns NULL if failed */
+/* Grows B by SIZE bits, which are set to false, and returns B.
+   The element array grows geometrically (at least doubling) with
+   realloc(), so the old bits are moved a whole array at a time
+   and repeated expansion costs amortized O(1) per bit.  Returns
+   NULL, leaving B as it was, if memory allocation failed.
+   Not for use on bitmaps created by bitmap_create_in_buf(). */
 struct bitmap* bitmap_expand(struct bitmap* b, int size){
-	if (!b || size == 0) return NULL;
-	size_t old_size = bitmap_size(b);
-	size_t cur_size = old_size + size;
-
-	struct bitmap* nb = bitmap_create(cur_size);
-	if (!nb) return NULL;
-	
-	for (size_t i = 0; i < old_size; i++){
-		if(bitmap_test(b, i))
-			bitmap_mark(nb, i);
+	if (!b) return NULL;
+	if (size <= 0) return b;
+	size_t old_elems = elem_cnt(b->bit_cnt);
+	size_t bit_cnt = b->bit_cnt + size;
+	size_t need = elem_cnt(bit_cnt);
+
+	if (need > b->elem_cap){
+		size_t cap = b->elem_cap * 2 > need ? b->elem_cap * 2 : need;
+		elem_type* bits = realloc(b->bits, cap * sizeof(elem_type));
+		if (!bits) return NULL;
+		b->bits = bits;
+		b->elem_cap = cap;
 	}
-	bitmap_destroy(b);
-	return nb;
+	// the old last element's unused bits are already zero
+	memset(b->bits + old_elems, 0, (need - old_elems) * sizeof(elem_type));
+	b->bit_cnt = bit_cnt;
+	return b;
 }
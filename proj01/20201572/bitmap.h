@@ -32,6 +32,13 @@ bool bitmap_any (const struct bitmap *, size_t start, size_t cnt);
 bool bitmap_none (const struct bitmap *, size_t start, size_t cnt);
 bool bitmap_all (const struct bitmap *, size_t start, size_t cnt);
 
+/* Set operations on whole bitmaps (vectorized). */
+void bitmap_and (struct bitmap *dst, const struct bitmap *src);
+void bitmap_or (struct bitmap *dst, const struct bitmap *src);
+void bitmap_xor (struct bitmap *dst, const struct bitmap *src);
+void bitmap_andnot (struct bitmap *dst, const struct bitmap *src);
+bool bitmap_equal (const struct bitmap *, const struct bitmap *);
+
 /* Finding set or unset bits. */
 #define BITMAP_ERROR SIZE_MAX
 size_t bitmap_scan (const struct bitmap *, size_t start, size_t cnt, bool);
@@ -54,6 +54,9 @@ struct hash
     size_t elem_cnt;            /* Number of elements in table. */
     size_t bucket_cnt;          /* Number of buckets, a power of 2. */
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    struct list *old_buckets;   /* Buckets being migrated from, or NULL. */
+    size_t old_bucket_cnt;      /* Number of old buckets. */
+    size_t migrated_cnt;        /* Old buckets [0, migrated_cnt) are moved. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
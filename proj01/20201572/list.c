@@ -1,5 +1,6 @@
 #include "list.h"
 #include <assert.h>	
+#include <string.h>
 #define ASSERT(CONDITION) assert(CONDITION)	
 
 /* Our doubly linked lists have two header elements: the "head"
@@ -409,9 +410,11 @@ inplace_merge (struct list_elem *a0, struct list_elem *a1b0,
 
 /* Sorts LIST according to LESS given auxiliary data AUX, using a
    natural iterative merge sort that runs in O(n lg n) time and
-   O(1) space in the number of elements in LIST. */
+   O(1) space in the number of elements in LIST.  Each pass walks
+   the whole list; list_sort() is faster but needs O(n) space.
+   Kept as the reference (and the fallback when memory is short). */
 void
-list_sort (struct list *list, list_less_func *less, void *aux)
+list_sort_natural (struct list *list, list_less_func *less, void *aux)
 {
   size_t output_run_cnt;        /* Number of runs output in current pass. */
 
@@ -448,6 +451,231 @@ list_sort (struct list *list, list_less_func *less, void *aux)
   ASSERT (is_sorted (list_begin (list), list_end (list), less, aux));
 }
 
+/* Relinks the N elements of ARRAY into LIST in array order.
+   They must be exactly the elements of LIST. */
+static void
+relink (struct list *list, struct list_elem **array, size_t n)
+{
+  struct list_elem *prev = &list->head;
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      prev->next = array[i];
+      array[i]->prev = prev;
+      prev = array[i];
+    }
+  prev->next = &list->tail;
+  list->tail.prev = prev;
+}
+
+/* Runs shorter than this are extended by insertion sort before
+   merging, as in timsort. */
+#define MIN_RUN 32
+
+/* Merges the sorted ranges A[LO...MID) and A[MID...HI) through
+   TMP, keeping equal elements in order.  Only the left range is
+   copied out, and nothing is done if the ranges are already in
+   order, so presorted input costs one comparison per merge. */
+static void
+merge_runs (struct list_elem **a, struct list_elem **tmp,
+            size_t lo, size_t mid, size_t hi,
+            list_less_func *less, void *aux)
+{
+  size_t i, j, k;
+
+  if (!less (a[mid], a[mid - 1], aux))
+    return;
+  memcpy (tmp + lo, a + lo, (mid - lo) * sizeof *a);
+  for (i = lo, j = mid, k = lo; i < mid && j < hi; k++)
+    if (less (a[j], tmp[i], aux))
+      a[k] = a[j++];
+    else
+      a[k] = tmp[i++];
+  while (i < mid)
+    a[k++] = tmp[i++];
+}
+
+/* Stable sort of the N elements of A: finds the natural runs,
+   reversing strictly descending ones and padding short ones to
+   MIN_RUN with binary insertion sort, then merges adjacent runs
+   bottom-up.  RUNS receives the run boundaries and must hold
+   N / MIN_RUN + 2 entries; TMP must hold N elements. */
+static void
+sort_array (struct list_elem **a, size_t n, struct list_elem **tmp,
+            size_t *runs, list_less_func *less, void *aux)
+{
+  size_t run_cnt = 0, lo = 0;
+
+  while (lo < n)
+    {
+      size_t hi = lo + 1, end;
+
+      if (hi < n && less (a[hi], a[lo], aux))
+        {
+          size_t i, j;
+          while (hi < n && less (a[hi], a[hi - 1], aux))
+            hi++;
+          for (i = lo, j = hi - 1; i < j; i++, j--)
+            swap (&a[i], &a[j]);
+        }
+      else
+        while (hi < n && !less (a[hi], a[hi - 1], aux))
+          hi++;
+
+      end = lo + MIN_RUN < n ? lo + MIN_RUN : n;
+      for (; hi < end; hi++)
+        {
+          struct list_elem *e = a[hi];
+          size_t l = lo, r = hi;
+
+          while (l < r)
+            {
+              size_t m = l + (r - l) / 2;
+              if (less (e, a[m], aux))
+                r = m;
+              else
+                l = m + 1;
+            }
+          memmove (a + l + 1, a + l, (hi - l) * sizeof *a);
+          a[l] = e;
+        }
+      runs[run_cnt++] = lo;
+      lo = hi;
+    }
+  runs[run_cnt] = n;
+
+  /* Merge pairs of adjacent runs until one is left. */
+  while (run_cnt > 1)
+    {
+      size_t i, out = 0;
+
+      for (i = 0; i + 1 < run_cnt; i += 2)
+        {
+          merge_runs (a, tmp, runs[i], runs[i + 1], runs[i + 2], less, aux);
+          runs[out++] = runs[i];
+        }
+      if (i < run_cnt)
+        runs[out++] = runs[i];
+      runs[out] = n;
+      run_cnt = out;
+    }
+}
+
+/* Sorts LIST according to LESS given auxiliary data AUX.  The
+   elements are copied into an array with list_to_array(), sorted
+   there by a stable timsort-style merge sort in O(n lg n) time
+   (O(n) for input that is already mostly in order), and relinked
+   in one pass.  Needs O(n) space; falls back to
+   list_sort_natural() if that can't be allocated.  Equal
+   elements keep their order, as with list_sort_natural(). */
+void
+list_sort (struct list *list, list_less_func *less, void *aux)
+{
+  struct list_elem **array, **tmp;
+  size_t n = list_size (list), *runs;
+
+  ASSERT (list != NULL);
+  ASSERT (less != NULL);
+  if (n < 2)
+    return;
+
+  array = malloc (n * sizeof *array);
+  tmp = malloc (n * sizeof *tmp);
+  runs = malloc ((n / MIN_RUN + 2) * sizeof *runs);
+  if (array == NULL || tmp == NULL || runs == NULL)
+    list_sort_natural (list, less, aux);
+  else
+    {
+      list_to_array (list, array, n);
+      sort_array (array, n, tmp, runs, less, aux);
+      relink (list, array, n);
+    }
+  free (array);
+  free (tmp);
+  free (runs);
+
+  ASSERT (is_sorted (list_begin (list), list_end (list), less, aux));
+}
+
+/* Sorts LIST, a list of `struct list_item's, by DATA in
+   nondecreasing order, like list_sort (list, cmp_list, NULL).
+   The keys are copied next to their elements into one array and
+   sorted with an LSD radix sort, one counting pass per byte of
+   the key (bytes all keys share are skipped, and so is all of
+   it if the list is already sorted), so this runs in O(n) time
+   without calling a comparison function.  Stable. */
+void
+list_sort_items (struct list *list)
+{
+  struct key_elem
+    {
+      uint32_t key;             /* DATA with the sign bit flipped. */
+      struct list_elem *elem;
+    } *a, *b, *t;
+  size_t count[4][256], n = list_size (list), i;
+  struct list_elem *e, **elems;
+  bool sorted = true;
+  int byte;
+
+  if (n < 2)
+    return;
+  a = malloc (n * sizeof *a);
+  b = malloc (n * sizeof *b);
+  if (a == NULL || b == NULL)
+    {
+      free (a);
+      free (b);
+      list_sort (list, (list_less_func *) cmp_list, NULL);
+      return;
+    }
+
+  /* Gather keys and all four byte histograms in one walk. */
+  memset (count, 0, sizeof count);
+  for (e = list_begin (list), i = 0; e != list_end (list); e = list_next (e), i++)
+    {
+      uint32_t key = (uint32_t) list_entry (e, struct list_item, elem)->data
+                     ^ 0x80000000u;
+      if (i > 0 && key < a[i - 1].key)
+        sorted = false;
+      a[i].key = key;
+      a[i].elem = e;
+      for (byte = 0; byte < 4; byte++)
+        count[byte][(key >> (byte * 8)) & 0xff]++;
+    }
+
+  for (byte = 0; byte < 4 && !sorted; byte++)
+    {
+      size_t *c = count[byte], sum = 0;
+      int shift = byte * 8;
+
+      if (c[a[0].key >> shift & 0xff] == n)
+        continue;
+      for (i = 0; i < 256; i++)
+        {
+          size_t cnt = c[i];
+          c[i] = sum;
+          sum += cnt;
+        }
+      for (i = 0; i < n; i++)
+        b[c[a[i].key >> shift & 0xff]++] = a[i];
+      t = a;
+      a = b;
+      b = t;
+    }
+
+  /* B is free again; reuse it for the element array. */
+  if (!sorted)
+    {
+      elems = (struct list_elem **) b;
+      for (i = 0; i < n; i++)
+        elems[i] = a[i].elem;
+      relink (list, elems, n);
+    }
+  free (a);
+  free (b);
+}
+
 /* Inserts ELEM in the proper position in LIST, which must be
    sorted according to LESS given auxiliary data AUX.
    Runs in O(n) average case in the number of elements in LIST. */
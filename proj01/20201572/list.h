@@ -160,6 +160,8 @@ typedef bool list_less_func (const struct list_elem *a,
 /* Operations on lists with ordered elements. */
 void list_sort (struct list *,
                 list_less_func *, void *aux);
+void list_sort_natural (struct list *,
+                        list_less_func *, void *aux);
 void list_insert_ordered (struct list *, struct list_elem *,
                           list_less_func *, void *aux);
 void list_unique (struct list *, struct list *duplicates,
@@ -177,4 +179,5 @@ struct list_elem* list_idx (struct list* list, int idx);
 void list_shuffle (struct list* list);
 void list_to_array(struct list* list, struct list_elem** array, size_t size);
 void list_cleanup(struct list* list);
+void list_sort_items (struct list* list);
 #endif /* list.h */
@@ -1,6 +1,8 @@
 #include "list.h"
 #include "hash.h"
 #include "bitmap.h"
+#include "vlist.h"
+#include "shash.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -15,6 +17,8 @@
 #define TYPE_LIST 0
 #define TYPE_HASH 1
 #define TYPE_BITMAP 2
+#define TYPE_VLIST 3		// unrolled list, same commands as list with a vlist_ prefix
+#define TYPE_SHASH 4		// open-addressing hash, same commands as hash with a shash_ prefix
 
 
 // macro for string comaparison used in function calls
@@ -25,6 +29,8 @@ void eval_func(int argc, char* argv[]);
 void list_func(int argc, char* argv[]);
 void hash_func(int argc, char* argv[]);
 void bitmap_func(int argc, char* argv[]);
+void vlist_func(int argc, char* argv[]);
+void shash_func(int argc, char* argv[]);
 int get_type(char* arg);
 void parse_file(int mode, const char* filename);
 struct data* find_data(const char* name);	// finds data based on name
@@ -45,6 +51,8 @@ struct data {
 	struct list list;
 	struct hash hash;
 	struct bitmap* bitmap;
+	struct vlist vlist;
+	struct shash shash;
 	char name[NAME_LEN];
 	int type;
 };
@@ -124,6 +132,14 @@ void eval_func(int argc, char* argv[]){
 			bitmap_func(argc, argv);
 			break;
 		}
+		case TYPE_VLIST:{
+			vlist_func(argc, argv);
+			break;
+		}
+		case TYPE_SHASH:{
+			shash_func(argc, argv);
+			break;
+		}
 		default:
 			perror("Invalid instruction\n");
 	}	
@@ -231,6 +247,14 @@ void list_func(int argc, char* argv[]){
 		if (argc != 2) return;
 		list_sort(&d->list, cmp_list, NULL);
 	}
+	else if (command("list_sort_items")){		// radix sort on the int keys
+		if (argc != 2) return;
+		list_sort_items(&d->list);
+	}
+	else if (command("list_sort_natural")){		// previous in-place merge sort, for comparison
+		if (argc != 2) return;
+		list_sort_natural(&d->list, cmp_list, NULL);
+	}
 	else if (command("list_splice")){	
 		if (argc != 6) return;
 		struct data* d2 = find_data(argv[3]);
@@ -438,15 +462,176 @@ void bitmap_func(int argc, char* argv[]){
 		if (argc != 2) return;
 		bitmap_dump(d->bitmap);
 	}
+	else if (command("bitmap_and") || command("bitmap_or")
+			|| command("bitmap_xor") || command("bitmap_andnot")){		// first bitmap op= second bitmap
+		if (argc != 3) return;
+		struct data* d2 = find_data(argv[2]);
+		if (d2 == NULL || d2->type != TYPE_BITMAP) return;
+		if (command("bitmap_and")) bitmap_and(d->bitmap, d2->bitmap);
+		else if (command("bitmap_or")) bitmap_or(d->bitmap, d2->bitmap);
+		else if (command("bitmap_xor")) bitmap_xor(d->bitmap, d2->bitmap);
+		else bitmap_andnot(d->bitmap, d2->bitmap);
+	}
+	else if (command("bitmap_equal")){
+		if (argc != 3) return;
+		struct data* d2 = find_data(argv[2]);
+		if (d2 == NULL || d2->type != TYPE_BITMAP) return;
+		if (bitmap_equal(d->bitmap, d2->bitmap)) printf("true\n");
+		else printf("false\n");
+	}
 	else if (command("bitmap_expand")){
 		if (argc != 3) return;
 		int size = strtol(argv[2], NULL, 10);
-		d->bitmap = bitmap_expand(d->bitmap, size); 
+		struct bitmap* nb = bitmap_expand(d->bitmap, size);
+		if (nb != NULL) d->bitmap = nb;		// on failure the old bitmap is still valid
 	}
 	
 	return;
 }
 
+/* unrolled list commands: same as list_func, but values live in chunks of ints so that
+indexed commands skip whole chunks instead of walking every element with list_idx() */
+void vlist_func(int argc, char* argv[]){
+	if (argc < 2) return;
+	struct data* d = find_data(argv[1]);
+	if (d == NULL) return;
+	if (command("vlist_push_back")){
+		if (argc != 3) return;
+		vlist_push_back(&d->vlist, strtol(argv[2], NULL, 10));
+	}
+	else if (command("vlist_push_front")){
+		if (argc != 3) return;
+		vlist_push_front(&d->vlist, strtol(argv[2], NULL, 10));
+	}
+	else if (command("vlist_pop_back")){
+		if (argc != 2) return;
+		vlist_pop_back(&d->vlist);
+	}
+	else if (command("vlist_pop_front")){
+		if (argc != 2) return;
+		vlist_pop_front(&d->vlist);
+	}
+	else if (command("vlist_front")){
+		if (argc != 2) return;
+		int* v = vlist_front(&d->vlist);
+		if (v != NULL) printf("%d\n", *v);
+	}
+	else if (command("vlist_back")){
+		if (argc != 2) return;
+		int* v = vlist_back(&d->vlist);
+		if (v != NULL) printf("%d\n", *v);
+	}
+	else if (command("vlist_empty")){
+		if (argc != 2) return;
+		if (vlist_empty(&d->vlist)) printf("true\n");
+		else printf("false\n");
+	}
+	else if (command("vlist_size")){
+		if (argc != 2) return;
+		printf("%zu\n", vlist_size(&d->vlist));
+	}
+	else if (command("vlist_max")){
+		if (argc != 2) return;
+		int* v = vlist_max(&d->vlist);
+		if (v != NULL) printf("%d\n", *v);
+	}
+	else if (command("vlist_min")){
+		if (argc != 2) return;
+		int* v = vlist_min(&d->vlist);
+		if (v != NULL) printf("%d\n", *v);
+	}
+	else if (command("vlist_insert")){
+		if (argc != 4) return;
+		vlist_insert(&d->vlist, strtol(argv[2], NULL, 10), strtol(argv[3], NULL, 10));
+	}
+	else if (command("vlist_remove")){
+		if (argc != 3) return;
+		vlist_remove(&d->vlist, strtol(argv[2], NULL, 10));
+	}
+	else if (command("vlist_swap")){
+		if (argc != 4) return;
+		vlist_swap(&d->vlist, strtol(argv[2], NULL, 10), strtol(argv[3], NULL, 10));
+	}
+	else if (command("vlist_shuffle")){
+		if (argc != 2) return;
+		vlist_shuffle(&d->vlist);
+	}
+	else if (command("vlist_reverse")){
+		if (argc != 2) return;
+		vlist_reverse(&d->vlist);
+	}
+	else if (command("vlist_sort")){
+		if (argc != 2) return;
+		vlist_sort(&d->vlist);
+	}
+	else if (command("vlist_splice")){
+		if (argc != 6) return;
+		struct data* d2 = find_data(argv[3]);
+		if (d2 == NULL || d2->type != TYPE_VLIST) return;
+		vlist_splice(&d->vlist, strtol(argv[2], NULL, 10), &d2->vlist, strtol(argv[4], NULL, 10), strtol(argv[5], NULL, 10));
+	}
+	else if (command("vlist_unique")){		// if given auxiliary list, put it to argument
+		if (argc == 3){
+			struct data* duplicate = find_data(argv[2]);
+			if (duplicate == NULL || duplicate->type != TYPE_VLIST) return;
+			vlist_unique(&d->vlist, &duplicate->vlist);
+		}
+		else if (argc == 2) vlist_unique(&d->vlist, NULL);
+	}
+	else if (command("vlist_insert_ordered")){
+		if (argc != 3) return;
+		vlist_insert_ordered(&d->vlist, strtol(argv[2], NULL, 10));
+	}
+	return;
+}
+
+/* open-addressing hash commands: same as hash_func, but items are stored in the table itself,
+so there is nothing to allocate or free per item */
+void shash_func(int argc, char* argv[]){
+	if (argc < 2) return;
+	struct data* d = find_data(argv[1]);
+	if (d == NULL) return;
+
+	if (command("shash_insert")){
+		if (argc != 3) return;
+		int key = strtol(argv[2], NULL, 10);
+		shash_insert(&d->shash, key, key);
+	}
+	else if (command("shash_delete")){
+		if (argc != 3) return;
+		shash_delete(&d->shash, strtol(argv[2], NULL, 10));
+	}
+	else if (command("shash_replace")){
+		if (argc != 3) return;
+		int key = strtol(argv[2], NULL, 10);
+		shash_replace(&d->shash, key, key);
+	}
+	else if (command("shash_empty")){
+		if (argc != 2) return;
+		if (shash_empty(&d->shash)) printf("true\n");
+		else printf("false\n");
+	}
+	else if (command("shash_size")){
+		if (argc != 2) return;
+		printf("%zu\n", shash_size(&d->shash));
+	}
+	else if (command("shash_find")){
+		if (argc != 3) return;
+		struct shash_item* item = shash_find(&d->shash, strtol(argv[2], NULL, 10));
+		if (item != NULL) printf("%d\n", item->value);
+	}
+	else if (command("shash_clear")){
+		if (argc != 2) return;
+		shash_clear(&d->shash);
+	}
+	else if (command("shash_apply")){
+		if (argc != 3) return;
+		if (strcmp(argv[2], "square") == 0) shash_apply(&d->shash, shash_square);
+		else if (strcmp(argv[2], "triple") == 0) shash_apply(&d->shash, shash_triple);
+	}
+	return;
+}
+
 // based on name, returns the data type we're dealing with
 int get_type(char* arg){	
 	// switch on first 4 letters : list, hash, bitm
@@ -459,6 +644,12 @@ int get_type(char* arg){
 	else if (strncmp(arg, "bitm", 4) == 0){
 		return TYPE_BITMAP;;
 	}
+	else if (strncmp(arg, "vlis", 4) == 0){
+		return TYPE_VLIST;
+	}
+	else if (strncmp(arg, "shas", 4) == 0){
+		return TYPE_SHASH;
+	}
 	else perror("Invalid data type\n");
 	return -1;
 }
@@ -533,6 +724,14 @@ void create(int type, const char* name, int* size){
 			d->bitmap = bitmap_create(*size);
 			break;
 		}
+		case TYPE_VLIST:{
+			vlist_init(&d->vlist);
+			break;
+		}
+		case TYPE_SHASH:{
+			shash_init(&d->shash);
+			break;
+		}
 	}
 	ds[struct_cnt] = d;	//save allocated memory address of data d in ds[]
 	return;
@@ -567,6 +766,22 @@ void dumpdata(struct data* d){
 			printf("\n");
 			break;
 		}
+		case TYPE_VLIST:{
+			if (vlist_empty(&d->vlist)) return;
+			struct list_elem* e;
+			for(e = list_begin(&d->vlist.chunks); e != list_end(&d->vlist.chunks); e = list_next(e)){
+				struct vlist_chunk* c = list_entry(e, struct vlist_chunk, elem);
+				for (size_t i = 0; i < c->cnt; i++) printf("%d ", c->data[i]);	// values of a chunk are contiguous
+			}
+			printf("\n");
+			break;
+		}
+		case TYPE_SHASH:{
+			if (shash_empty(&d->shash)) return;
+			shash_apply(&d->shash, shash_print);
+			printf("\n");
+			break;
+		}
 		default: perror("Invalid type.\n");
 	}
 	return;
@@ -586,6 +801,14 @@ void delete(struct data* d){
 			bitmap_destroy(d->bitmap);		// free bitmap struct in heap
 		break;
 		}
+		case TYPE_VLIST:{
+			vlist_cleanup(&d->vlist);		// free chunks in heap
+			break;
+		}
+		case TYPE_SHASH:{
+			shash_destroy(&d->shash);		// items live in the table, nothing else to free
+			break;
+		}
 		default: perror("Invalid type.\n");
 	}
 	return;
@@ -0,0 +1,303 @@
+/* Open-addressing hash table.
+
+See shash.h for basic information. */
+
+#include "shash.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+#define NO_SLOT SIZE_MAX
+
+static bool resize (struct shash *, size_t slot_cnt);
+
+/* Returns a well-mixed hash of KEY (MurmurHash3's finalizer, on
+   unsigned arithmetic).  The low 7 bits become H2, the rest H1. */
+static inline unsigned
+hash_key (int key)
+{
+  uint32_t h = (uint32_t) key;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+#define H1(HASH) ((HASH) >> 7)
+#define H2(HASH) ((int8_t) ((HASH) & 0x7f))
+
+/* Returns a bitmask with bit I set if control byte I of the
+   group at G equals B. */
+static inline unsigned
+match_byte (const int8_t *g, int8_t b)
+{
+#ifdef __SSE2__
+  __m128i ctrl = _mm_loadu_si128 ((const __m128i *) g);
+  return _mm_movemask_epi8 (_mm_cmpeq_epi8 (ctrl, _mm_set1_epi8 (b)));
+#else
+  unsigned mask = 0;
+  int i;
+  for (i = 0; i < SHASH_GROUP; i++)
+    if (g[i] == b)
+      mask |= 1u << i;
+  return mask;
+#endif
+}
+
+/* Returns a bitmask with bit I set if slot I of the group at G is
+   free, that is, empty or deleted.  Both have the top bit set,
+   which no used slot's H2 does. */
+static inline unsigned
+match_free (const int8_t *g)
+{
+#ifdef __SSE2__
+  return _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i *) g));
+#else
+  unsigned mask = 0;
+  int i;
+  for (i = 0; i < SHASH_GROUP; i++)
+    if (g[i] < 0)
+      mask |= 1u << i;
+  return mask;
+#endif
+}
+
+/* Returns the index of the slot in H holding KEY, whose hash is
+   HASH, or NO_SLOT. */
+static size_t
+find_slot (struct shash *h, int key, unsigned hash)
+{
+  size_t group_mask = h->slot_cnt / SHASH_GROUP - 1;
+  size_t g = H1 (hash) & group_mask, step = 0;
+
+  for (;;)
+    {
+      const int8_t *ctrl = h->ctrl + g * SHASH_GROUP;
+      unsigned m;
+
+      for (m = match_byte (ctrl, H2 (hash)); m != 0; m &= m - 1)
+        {
+          size_t i = g * SHASH_GROUP + __builtin_ctz (m);
+          if (h->slots[i].key == key)
+            return i;
+        }
+      if (match_byte (ctrl, SHASH_EMPTY))
+        return NO_SLOT;
+      g = (g + ++step) & group_mask;
+    }
+}
+
+/* Returns the index of the first free slot on the probe sequence
+   for HASH in H.  H must have an empty slot. */
+static size_t
+find_free (struct shash *h, unsigned hash)
+{
+  size_t group_mask = h->slot_cnt / SHASH_GROUP - 1;
+  size_t g = H1 (hash) & group_mask, step = 0;
+  unsigned m;
+
+  while ((m = match_free (h->ctrl + g * SHASH_GROUP)) == 0)
+    g = (g + ++step) & group_mask;
+  return g * SHASH_GROUP + __builtin_ctz (m);
+}
+
+/* Initializes H as an empty table of SHASH_GROUP slots. */
+bool
+shash_init (struct shash *h)
+{
+  h->slot_cnt = 0;
+  h->ctrl = NULL;
+  h->slots = NULL;
+  h->elem_cnt = h->deleted_cnt = 0;
+  return resize (h, SHASH_GROUP);
+}
+
+/* Removes all the items from H. */
+void
+shash_clear (struct shash *h)
+{
+  memset (h->ctrl, SHASH_EMPTY, h->slot_cnt);
+  h->elem_cnt = h->deleted_cnt = 0;
+}
+
+/* Destroys hash table H. */
+void
+shash_destroy (struct shash *h)
+{
+  free (h->ctrl);
+  free (h->slots);
+}
+
+/* Inserts KEY with VALUE into H and returns a null pointer, if
+   KEY is not already in the table.  If it is, returns its item
+   without changing it. */
+struct shash_item *
+shash_insert (struct shash *h, int key, int value)
+{
+  unsigned hash = hash_key (key);
+  size_t i = find_slot (h, key, hash);
+
+  if (i != NO_SLOT)
+    return &h->slots[i];
+
+  /* Keep at least 1/8 of the slots empty, so that probes stay
+     short and always end.  If mostly tombstones are in the way,
+     rebuild at the same size to clear them.  If the table can't
+     grow it is still usable until it is completely full. */
+  if ((h->elem_cnt + h->deleted_cnt + 1) * 8 > h->slot_cnt * 7)
+    {
+      size_t new_cnt = h->slot_cnt;
+      if ((h->elem_cnt + 1) * 16 > h->slot_cnt * 7)
+        new_cnt *= 2;
+      if (!resize (h, new_cnt))
+        ASSERT (h->elem_cnt + h->deleted_cnt + 1 < h->slot_cnt);
+    }
+
+  i = find_free (h, hash);
+  if (h->ctrl[i] == SHASH_DELETED)
+    h->deleted_cnt--;
+  h->ctrl[i] = H2 (hash);
+  h->slots[i].key = key;
+  h->slots[i].value = value;
+  h->elem_cnt++;
+  return NULL;
+}
+
+/* Sets the value of KEY in H to VALUE, inserting it if it is not
+   in the table.  Returns true if it was. */
+bool
+shash_replace (struct shash *h, int key, int value)
+{
+  struct shash_item *old = shash_insert (h, key, value);
+
+  if (old != NULL)
+    old->value = value;
+  return old != NULL;
+}
+
+/* Finds and returns the item with KEY in H, or a null pointer if
+   KEY is not in the table. */
+struct shash_item *
+shash_find (struct shash *h, int key)
+{
+  size_t i = find_slot (h, key, hash_key (key));
+  return i != NO_SLOT ? &h->slots[i] : NULL;
+}
+
+/* Removes KEY from H.  Returns false if it was not in the
+   table. */
+bool
+shash_delete (struct shash *h, int key)
+{
+  size_t i = find_slot (h, key, hash_key (key));
+
+  if (i == NO_SLOT)
+    return false;
+
+  /* A lookup only moves on past a group with no empty slot, so
+     if this group has one no probe sequence runs through it and
+     the slot can be made empty instead of a tombstone. */
+  if (match_byte (h->ctrl + (i & ~(size_t) (SHASH_GROUP - 1)), SHASH_EMPTY))
+    h->ctrl[i] = SHASH_EMPTY;
+  else
+    {
+      h->ctrl[i] = SHASH_DELETED;
+      h->deleted_cnt++;
+    }
+  h->elem_cnt--;
+
+  if (h->slot_cnt > SHASH_GROUP && h->elem_cnt * 8 < h->slot_cnt)
+    resize (h, h->slot_cnt / 2);
+  return true;
+}
+
+/* Calls ACTION for each item in hash table H in arbitrary order.
+   ACTION must not change the item's key, and modifying H while
+   shash_apply() is running yields undefined behavior. */
+void
+shash_apply (struct shash *h, shash_action_func *action)
+{
+  size_t i;
+
+  ASSERT (action != NULL);
+
+  for (i = 0; i < h->slot_cnt; i++)
+    if (h->ctrl[i] >= 0)
+      action (&h->slots[i]);
+}
+
+/* Returns the number of items in H. */
+size_t
+shash_size (struct shash *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no items, false otherwise. */
+bool
+shash_empty (struct shash *h)
+{
+  return h->elem_cnt == 0;
+}
+
+/* Moves the items of H into new arrays of SLOT_CNT slots,
+   dropping all tombstones.  On allocation failure returns false
+   and leaves H as it was. */
+static bool
+resize (struct shash *h, size_t slot_cnt)
+{
+  struct shash h2;
+  size_t i;
+
+  h2.slot_cnt = slot_cnt;
+  h2.ctrl = malloc (slot_cnt);
+  h2.slots = malloc (sizeof *h2.slots * slot_cnt);
+  if (h2.ctrl == NULL || h2.slots == NULL)
+    {
+      free (h2.ctrl);
+      free (h2.slots);
+      return false;
+    }
+  memset (h2.ctrl, SHASH_EMPTY, slot_cnt);
+
+  /* The keys are known to be distinct, so only free slots need
+     to be looked for. */
+  for (i = 0; i < h->slot_cnt; i++)
+    if (h->ctrl[i] >= 0)
+      {
+        unsigned hash = hash_key (h->slots[i].key);
+        size_t j = find_free (&h2, hash);
+        h2.ctrl[j] = H2 (hash);
+        h2.slots[j] = h->slots[i];
+      }
+
+  free (h->ctrl);
+  free (h->slots);
+  h->ctrl = h2.ctrl;
+  h->slots = h2.slots;
+  h->slot_cnt = slot_cnt;
+  h->deleted_cnt = 0;
+  return true;
+}
+
+void shash_print(struct shash_item* i){
+	printf("%d ", i->value);
+}
+
+// squares item value
+void shash_square(struct shash_item* i){
+	i->value = i->value * i->value;
+}
+
+// triples item value
+void shash_triple(struct shash_item* i){
+	i->value = i->value * i->value * i->value;
+}
@@ -0,0 +1,79 @@
+#ifndef __MYLIB_SHASH_H
+#define __MYLIB_SHASH_H
+
+/* Open-addressing hash table of int keys and values.
+
+   The int key/value case of hash.h (struct hash_item keyed by
+   KEY) without the chains: items are stored by value in one
+   array of slots, and a parallel array holds one control byte
+   per slot, in the style of Abseil's "Swiss table".  A control
+   byte is SHASH_EMPTY, SHASH_DELETED (a tombstone), or, for a
+   slot in use, the low 7 bits of the key's hash (H2).
+
+   The slots are divided into groups of SHASH_GROUP.  A key's
+   remaining hash bits (H1) pick the group to start at; the 16
+   control bytes of a group are compared against H2 with a
+   single SSE2 instruction, so usually only the one slot that
+   matches is compared by key, and a lookup ends at the first
+   group that has an empty slot.  Groups are probed
+   quadratically.
+
+   The table grows (or is rebuilt in place to drop tombstones)
+   when used plus deleted slots would exceed 7/8 of the slots,
+   and shrinks when it falls under 1/8 full.
+
+   Pointers returned by shash_find() and shash_insert() are only
+   valid until the next insertion or deletion. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHASH_GROUP 16          /* Slots per probed group. */
+#define SHASH_EMPTY ((int8_t) -128)   /* 0x80: never used. */
+#define SHASH_DELETED ((int8_t) -2)   /* 0xfe: tombstone. */
+
+/* Key/value pair, stored in the table itself. */
+struct shash_item
+  {
+    int key;
+    int value;
+  };
+
+/* Performs some operation on item I. */
+typedef void shash_action_func (struct shash_item *i);
+
+/* Hash table. */
+struct shash
+  {
+    size_t elem_cnt;            /* Number of items in table. */
+    size_t deleted_cnt;         /* Number of tombstones. */
+    size_t slot_cnt;            /* Number of slots, a power of 2 >= SHASH_GROUP. */
+    int8_t *ctrl;               /* Array of `slot_cnt' control bytes. */
+    struct shash_item *slots;   /* Array of `slot_cnt' items. */
+  };
+
+/* Basic life cycle. */
+bool shash_init (struct shash *);
+void shash_clear (struct shash *);
+void shash_destroy (struct shash *);
+
+/* Search, insertion, deletion. */
+struct shash_item *shash_insert (struct shash *, int key, int value);
+bool shash_replace (struct shash *, int key, int value);
+struct shash_item *shash_find (struct shash *, int key);
+bool shash_delete (struct shash *, int key);
+
+/* Iteration. */
+void shash_apply (struct shash *, shash_action_func *);
+
+/* Information. */
+size_t shash_size (struct shash *);
+bool shash_empty (struct shash *);
+
+/* proj1 shash_action_funcs, as for hash.h */
+void shash_print (struct shash_item *i);
+void shash_square (struct shash_item *i);
+void shash_triple (struct shash_item *i);
+
+#endif /* shash.h */
@@ -0,0 +1,571 @@
+#include "vlist.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#define ASSERT(CONDITION) assert(CONDITION)
+
+/* See vlist.h for an overview.  The chunks are kept in a struct
+   list from list.h; struct vlist_chunk's ELEM links them. */
+
+#define chunk_entry(ELEM) list_entry (ELEM, struct vlist_chunk, elem)
+
+static struct vlist_chunk *
+chunk_new (void)
+{
+  struct vlist_chunk *c = malloc (sizeof *c);
+  ASSERT (c != NULL);
+  c->cnt = 0;
+  return c;
+}
+
+static void
+chunk_free (struct vlist_chunk *c)
+{
+  list_remove (&c->elem);
+  free (c);
+}
+
+/* Returns the chunk holding the value at IDX in VL and stores
+   the value's position within that chunk in *OFF, or returns
+   NULL if IDX is out of range.  Walks from whichever end is
+   nearer. */
+static struct vlist_chunk *
+locate (struct vlist *vl, size_t idx, size_t *off)
+{
+  struct list_elem *e;
+  size_t pos;
+
+  if (idx >= vl->size)
+    return NULL;
+  if (idx < vl->size / 2)
+    {
+      pos = 0;
+      for (e = list_begin (&vl->chunks); e != list_end (&vl->chunks);
+           e = list_next (e))
+        {
+          struct vlist_chunk *c = chunk_entry (e);
+          if (idx < pos + c->cnt)
+            {
+              *off = idx - pos;
+              return c;
+            }
+          pos += c->cnt;
+        }
+    }
+  else
+    {
+      pos = vl->size;
+      for (e = list_rbegin (&vl->chunks); e != list_rend (&vl->chunks);
+           e = list_prev (e))
+        {
+          struct vlist_chunk *c = chunk_entry (e);
+          pos -= c->cnt;
+          if (idx >= pos)
+            {
+              *off = idx - pos;
+              return c;
+            }
+        }
+    }
+  ASSERT (0);
+  return NULL;
+}
+
+/* Merges C with its successor if both fit in half a chunk. */
+static void
+chunk_merge_next (struct vlist *vl, struct vlist_chunk *c)
+{
+  struct vlist_chunk *next;
+
+  if (list_next (&c->elem) == list_end (&vl->chunks))
+    return;
+  next = chunk_entry (list_next (&c->elem));
+  if (c->cnt + next->cnt > VLIST_CHUNK / 2)
+    return;
+  memcpy (c->data + c->cnt, next->data, next->cnt * sizeof (int));
+  c->cnt += next->cnt;
+  chunk_free (next);
+}
+
+/* Inserts VALUE at position OFF of chunk C, splitting C in half
+   first if it is full. */
+static void
+chunk_insert (struct vlist *vl, struct vlist_chunk *c, size_t off, int value)
+{
+  if (c->cnt == VLIST_CHUNK)
+    {
+      struct vlist_chunk *n = chunk_new ();
+      size_t half = VLIST_CHUNK / 2;
+
+      n->cnt = VLIST_CHUNK - half;
+      memcpy (n->data, c->data + half, n->cnt * sizeof (int));
+      c->cnt = half;
+      list_insert (list_next (&c->elem), &n->elem);
+      if (off > half)
+        {
+          c = n;
+          off -= half;
+        }
+    }
+  memmove (c->data + off + 1, c->data + off, (c->cnt - off) * sizeof (int));
+  c->data[off] = value;
+  c->cnt++;
+  vl->size++;
+}
+
+/* Removes the value at position OFF of chunk C.  An emptied
+   chunk is freed, a sparse one merged with a neighbour. */
+static void
+chunk_erase (struct vlist *vl, struct vlist_chunk *c, size_t off)
+{
+  memmove (c->data + off, c->data + off + 1, (c->cnt - off - 1) * sizeof (int));
+  c->cnt--;
+  vl->size--;
+  if (c->cnt == 0)
+    chunk_free (c);
+  else if (list_prev (&c->elem) != list_rend (&vl->chunks)
+           && chunk_entry (list_prev (&c->elem))->cnt + c->cnt <= VLIST_CHUNK / 2)
+    chunk_merge_next (vl, chunk_entry (list_prev (&c->elem)));
+  else
+    chunk_merge_next (vl, c);
+}
+
+/* Inserts the N values in ARRAY before position IDX of VL (at
+   the end if IDX is out of range), as whole new chunks. */
+static void
+insert_array (struct vlist *vl, size_t idx, const int *array, size_t n)
+{
+  struct list_elem *before = list_end (&vl->chunks);
+  struct vlist_chunk *c;
+  size_t off;
+
+  if (n == 0)
+    return;
+  if ((c = locate (vl, idx, &off)) != NULL)
+    {
+      before = &c->elem;
+      if (off > 0)
+        {
+          /* Split C at OFF; the new values go in between. */
+          struct vlist_chunk *t = chunk_new ();
+          t->cnt = c->cnt - off;
+          memcpy (t->data, c->data + off, t->cnt * sizeof (int));
+          c->cnt = off;
+          list_insert (list_next (&c->elem), &t->elem);
+          before = &t->elem;
+        }
+    }
+  vl->size += n;
+  while (n > 0)
+    {
+      struct vlist_chunk *nc = chunk_new ();
+      nc->cnt = n < VLIST_CHUNK ? n : VLIST_CHUNK;
+      memcpy (nc->data, array, nc->cnt * sizeof (int));
+      list_insert (before, &nc->elem);
+      array += nc->cnt;
+      n -= nc->cnt;
+    }
+}
+
+/* Overwrites the values of VL in order with those in ARRAY,
+   keeping the chunk layout. */
+static void
+array_to_chunks (struct vlist *vl, const int *array)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&vl->chunks); e != list_end (&vl->chunks);
+       e = list_next (e))
+    {
+      struct vlist_chunk *c = chunk_entry (e);
+      memcpy (c->data, array, c->cnt * sizeof (int));
+      array += c->cnt;
+    }
+}
+
+/* Initializes VL as an empty list. */
+void
+vlist_init (struct vlist *vl)
+{
+  ASSERT (vl != NULL);
+  list_init (&vl->chunks);
+  vl->size = 0;
+}
+
+/* Frees all chunks of VL, leaving it empty. */
+void
+vlist_cleanup (struct vlist *vl)
+{
+  while (!list_empty (&vl->chunks))
+    free (chunk_entry (list_pop_front (&vl->chunks)));
+  vl->size = 0;
+}
+
+/* Returns a pointer to the value at IDX in VL, or NULL if IDX is
+   out of range. */
+int *
+vlist_idx (struct vlist *vl, size_t idx)
+{
+  size_t off;
+  struct vlist_chunk *c = locate (vl, idx, &off);
+  return c != NULL ? &c->data[off] : NULL;
+}
+
+/* Returns a pointer to the first value in VL, or NULL if VL is
+   empty. */
+int *
+vlist_front (struct vlist *vl)
+{
+  if (vlist_empty (vl))
+    return NULL;
+  return &chunk_entry (list_front (&vl->chunks))->data[0];
+}
+
+/* Returns a pointer to the last value in VL, or NULL if VL is
+   empty. */
+int *
+vlist_back (struct vlist *vl)
+{
+  struct vlist_chunk *c;
+
+  if (vlist_empty (vl))
+    return NULL;
+  c = chunk_entry (list_back (&vl->chunks));
+  return &c->data[c->cnt - 1];
+}
+
+/* Inserts VALUE so that it ends up at position IDX, or at the end
+   of VL if IDX is out of range. */
+void
+vlist_insert (struct vlist *vl, size_t idx, int value)
+{
+  size_t off;
+  struct vlist_chunk *c = locate (vl, idx, &off);
+
+  if (c == NULL)
+    vlist_push_back (vl, value);
+  else
+    chunk_insert (vl, c, off, value);
+}
+
+/* Removes the value at IDX.  Returns false if IDX is out of
+   range. */
+bool
+vlist_remove (struct vlist *vl, size_t idx)
+{
+  size_t off;
+  struct vlist_chunk *c = locate (vl, idx, &off);
+
+  if (c == NULL)
+    return false;
+  chunk_erase (vl, c, off);
+  return true;
+}
+
+void
+vlist_push_front (struct vlist *vl, int value)
+{
+  struct vlist_chunk *c;
+
+  if (vlist_empty (vl)
+      || chunk_entry (list_front (&vl->chunks))->cnt == VLIST_CHUNK)
+    {
+      c = chunk_new ();
+      list_push_front (&vl->chunks, &c->elem);
+    }
+  else
+    c = chunk_entry (list_front (&vl->chunks));
+  chunk_insert (vl, c, 0, value);
+}
+
+/* Appends VALUE.  A full back chunk is not split; a new one is
+   started, so that a list built by appending stays dense. */
+void
+vlist_push_back (struct vlist *vl, int value)
+{
+  struct vlist_chunk *c;
+
+  if (vlist_empty (vl)
+      || chunk_entry (list_back (&vl->chunks))->cnt == VLIST_CHUNK)
+    {
+      c = chunk_new ();
+      list_push_back (&vl->chunks, &c->elem);
+    }
+  else
+    c = chunk_entry (list_back (&vl->chunks));
+  c->data[c->cnt++] = value;
+  vl->size++;
+}
+
+bool
+vlist_pop_front (struct vlist *vl)
+{
+  if (vlist_empty (vl))
+    return false;
+  chunk_erase (vl, chunk_entry (list_front (&vl->chunks)), 0);
+  return true;
+}
+
+bool
+vlist_pop_back (struct vlist *vl)
+{
+  struct vlist_chunk *c;
+
+  if (vlist_empty (vl))
+    return false;
+  c = chunk_entry (list_back (&vl->chunks));
+  chunk_erase (vl, c, c->cnt - 1);
+  return true;
+}
+
+/* Removes the values at FIRST...LAST (exclusive) from SRC and
+   inserts them before position BEFORE of VL, like list_splice().
+   LAST past the end of SRC means its end; BEFORE past the end of
+   VL means VL's end.  SRC may be VL, with BEFORE outside the
+   range being moved. */
+void
+vlist_splice (struct vlist *vl, size_t before,
+              struct vlist *src, size_t first, size_t last)
+{
+  struct vlist_chunk *c, *next, *start;
+  size_t off, n, i;
+  int *tmp;
+
+  if (last > src->size)
+    last = src->size;
+  if (first >= last)
+    return;
+  n = last - first;
+  tmp = malloc (n * sizeof (int));
+  if (tmp == NULL)
+    return;
+
+  /* Move the range out of SRC a chunk at a time.  Only the
+     chunk it starts in can be left sparse at the front. */
+  c = locate (src, first, &off);
+  start = off > 0 ? c : NULL;
+  for (i = 0; i < n; c = next, off = 0)
+    {
+      size_t k = c->cnt - off < n - i ? c->cnt - off : n - i;
+
+      next = chunk_entry (list_next (&c->elem));
+      memcpy (tmp + i, c->data + off, k * sizeof (int));
+      memmove (c->data + off, c->data + off + k,
+               (c->cnt - off - k) * sizeof (int));
+      c->cnt -= k;
+      i += k;
+      if (c->cnt == 0)
+        chunk_free (c);
+    }
+  src->size -= n;
+  if (start != NULL)
+    chunk_merge_next (src, start);
+
+  if (src == vl && before > first)
+    before = before >= last ? before - n : first;
+  insert_array (vl, before, tmp, n);
+  free (tmp);
+}
+
+size_t
+vlist_size (struct vlist *vl)
+{
+  return vl->size;
+}
+
+bool
+vlist_empty (struct vlist *vl)
+{
+  return vl->size == 0;
+}
+
+/* Returns a pointer to the largest value in VL, the earliest one
+   if there are several, or NULL if VL is empty. */
+int *
+vlist_max (struct vlist *vl)
+{
+  struct list_elem *e;
+  int *max = vlist_front (vl);
+  size_t i;
+
+  for (e = list_begin (&vl->chunks); e != list_end (&vl->chunks);
+       e = list_next (e))
+    {
+      struct vlist_chunk *c = chunk_entry (e);
+      for (i = 0; i < c->cnt; i++)
+        if (*max < c->data[i])
+          max = &c->data[i];
+    }
+  return max;
+}
+
+/* Returns a pointer to the smallest value in VL, the earliest
+   one if there are several, or NULL if VL is empty. */
+int *
+vlist_min (struct vlist *vl)
+{
+  struct list_elem *e;
+  int *min = vlist_front (vl);
+  size_t i;
+
+  for (e = list_begin (&vl->chunks); e != list_end (&vl->chunks);
+       e = list_next (e))
+    {
+      struct vlist_chunk *c = chunk_entry (e);
+      for (i = 0; i < c->cnt; i++)
+        if (c->data[i] < *min)
+          min = &c->data[i];
+    }
+  return min;
+}
+
+/* Swaps the values at A and B.  Does nothing if either is out of
+   range. */
+void
+vlist_swap (struct vlist *vl, size_t a, size_t b)
+{
+  int *pa = vlist_idx (vl, a);
+  int *pb = vlist_idx (vl, b);
+  int tmp;
+
+  if (pa == NULL || pb == NULL)
+    return;
+  tmp = *pa;
+  *pa = *pb;
+  *pb = tmp;
+}
+
+/* Reverses the order of the chunks, then each chunk in place. */
+void
+vlist_reverse (struct vlist *vl)
+{
+  struct list_elem *e;
+
+  list_reverse (&vl->chunks);
+  for (e = list_begin (&vl->chunks); e != list_end (&vl->chunks);
+       e = list_next (e))
+    {
+      struct vlist_chunk *c = chunk_entry (e);
+      size_t i, j;
+
+      for (i = 0, j = c->cnt - 1; i < j; i++, j--)
+        {
+          int tmp = c->data[i];
+          c->data[i] = c->data[j];
+          c->data[j] = tmp;
+        }
+    }
+}
+
+/* Shuffles VL with Fisher-Yates on a flat copy, as
+   list_shuffle() does. */
+void
+vlist_shuffle (struct vlist *vl)
+{
+  size_t size = vl->size;
+  int *array;
+
+  if (size < 2)
+    return;
+  if ((array = malloc (size * sizeof (int))) == NULL)
+    return;
+  vlist_to_array (vl, array);
+  for (size_t i = size - 1; i > 0; i--)
+    {
+      size_t j = rand () % (i + 1);
+      int tmp = array[i];
+      array[i] = array[j];
+      array[j] = tmp;
+    }
+  array_to_chunks (vl, array);
+  free (array);
+}
+
+static int
+cmp_int (const void *a, const void *b)
+{
+  int x = *(const int *) a, y = *(const int *) b;
+  return (x > y) - (x < y);
+}
+
+/* Sorts VL into nondecreasing order. */
+void
+vlist_sort (struct vlist *vl)
+{
+  int *array;
+
+  if (vl->size < 2)
+    return;
+  if ((array = malloc (vl->size * sizeof (int))) == NULL)
+    return;
+  vlist_to_array (vl, array);
+  qsort (array, vl->size, sizeof (int), cmp_int);
+  array_to_chunks (vl, array);
+  free (array);
+}
+
+/* Inserts VALUE before the first value greater than it, as
+   list_insert_ordered() does. */
+void
+vlist_insert_ordered (struct vlist *vl, int value)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&vl->chunks); e != list_end (&vl->chunks);
+       e = list_next (e))
+    {
+      struct vlist_chunk *c = chunk_entry (e);
+      size_t i;
+
+      for (i = 0; i < c->cnt; i++)
+        if (value < c->data[i])
+          {
+            chunk_insert (vl, c, i, value);
+            return;
+          }
+    }
+  vlist_push_back (vl, value);
+}
+
+/* Removes each value equal to the one before it, appending it
+   to DUPLICATES if that is non-null, as list_unique() does. */
+void
+vlist_unique (struct vlist *vl, struct vlist *duplicates)
+{
+  size_t size = vl->size, kept, i;
+  int *array;
+
+  if (size < 2)
+    return;
+  if ((array = malloc (size * sizeof (int))) == NULL)
+    return;
+  vlist_to_array (vl, array);
+  for (kept = 1, i = 1; i < size; i++)
+    if (array[i] == array[kept - 1])
+      {
+        if (duplicates != NULL)
+          vlist_push_back (duplicates, array[i]);
+      }
+    else
+      array[kept++] = array[i];
+  if (kept < size)
+    {
+      vlist_cleanup (vl);
+      insert_array (vl, 0, array, kept);
+    }
+  free (array);
+}
+
+void
+vlist_to_array (struct vlist *vl, int *array)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&vl->chunks); e != list_end (&vl->chunks);
+       e = list_next (e))
+    {
+      struct vlist_chunk *c = chunk_entry (e);
+      memcpy (array, c->data, c->cnt * sizeof (int));
+      array += c->cnt;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef __MYLIB_VLIST_H
+#define __MYLIB_VLIST_H
+
+/* Unrolled list of ints.
+
+   Same operations as the list of `struct list_item's in list.h,
+   but the values are stored by value in chunks of up to
+   VLIST_CHUNK ints, and the chunks themselves are linked with a
+   struct list.  Finding the element at an index skips whole
+   chunks, so indexed insert/remove/swap cost O(n/VLIST_CHUNK +
+   VLIST_CHUNK) instead of the O(n) pointer chase of list_idx(),
+   and iteration is a sequential scan of each chunk's array.
+
+   A full chunk is split in half on insert; after a removal, a
+   chunk is merged with a neighbour when the two together fit in
+   half a chunk, so chunks don't thin out into a linked list.
+
+   Indexes are 0-based.  An index at or past the end means "not
+   found" (NULL / false), except for vlist_insert() where it
+   appends, like the list_insert command. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "list.h"
+
+#define VLIST_CHUNK 64          /* Ints per chunk. */
+
+/* Chunk of consecutive values. */
+struct vlist_chunk
+  {
+    struct list_elem elem;      /* Element in vlist's chunk list. */
+    size_t cnt;                 /* Number of values in use. */
+    int data[VLIST_CHUNK];      /* Values, data[0...cnt-1]. */
+  };
+
+/* Unrolled list. */
+struct vlist
+  {
+    struct list chunks;         /* List of struct vlist_chunk. */
+    size_t size;                /* Total number of values. */
+  };
+
+void vlist_init (struct vlist *);
+void vlist_cleanup (struct vlist *);
+
+/* Access. */
+int *vlist_idx (struct vlist *, size_t idx);
+int *vlist_front (struct vlist *);
+int *vlist_back (struct vlist *);
+
+/* Insertion and removal. */
+void vlist_insert (struct vlist *, size_t idx, int value);
+bool vlist_remove (struct vlist *, size_t idx);
+void vlist_push_front (struct vlist *, int value);
+void vlist_push_back (struct vlist *, int value);
+bool vlist_pop_front (struct vlist *);
+bool vlist_pop_back (struct vlist *);
+void vlist_splice (struct vlist *, size_t before,
+                   struct vlist *src, size_t first, size_t last);
+
+/* Properties. */
+size_t vlist_size (struct vlist *);
+bool vlist_empty (struct vlist *);
+int *vlist_max (struct vlist *);
+int *vlist_min (struct vlist *);
+
+/* Reordering. */
+void vlist_swap (struct vlist *, size_t a, size_t b);
+void vlist_reverse (struct vlist *);
+void vlist_shuffle (struct vlist *);
+void vlist_sort (struct vlist *);
+void vlist_insert_ordered (struct vlist *, int value);
+void vlist_unique (struct vlist *, struct vlist *duplicates);
+
+/* Copies all values in order into ARRAY, which must hold
+   vlist_size() ints. */
+void vlist_to_array (struct vlist *, int *array);
+
+#endif /* vlist.h */
@@ -0,0 +1,125 @@
+/*
+ * replay.c - replays a recorded stockserver trace against a live server
+ *
+ * Requests are sent in recorded order, one connection per recorded
+ * connection id, waiting for each response before the next request, so
+ * the stock operations are applied in the same order as when recorded.
+ * The server should be started from the stock.txt the recording started
+ * with; -c compares the final state with the stock.txt it ended with.
+ */
+#include "csapp.h"
+#include "trace.h"
+#include <time.h>
+
+struct replay_conn {
+	int fd;
+	rio_t rio;
+};
+
+static double elapsed(struct timespec* start){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// waits until ts_us after start (original speed replay)
+static void wait_until(struct timespec* start, unsigned long long ts_us){
+	double delay = ts_us / 1e6 - elapsed(start);
+	if (delay > 0) usleep((useconds_t)(delay * 1e6));
+}
+
+// asks the server for its stock table and compares it with the contents of filename
+static int check_stock(char* host, char* port, const char* filename){
+	char expected[MAXLINE] = { '\0' }, buf[MAXLINE];
+	size_t n;
+	rio_t rio;
+	FILE* fp = fopen(filename, "r");
+	int clientfd;
+
+	if (!fp){
+		fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+		return -1;
+	}
+	n = fread(expected, 1, MAXLINE - 1, fp);
+	expected[n] = '\0';
+	fclose(fp);
+
+	clientfd = Open_clientfd(host, port);
+	Rio_readinitb(&rio, clientfd);
+	Rio_writen(clientfd, "show\n", 5);
+	Rio_readnb(&rio, buf, MAXLINE);
+	Close(clientfd);
+	buf[MAXLINE - 1] = '\0';
+
+	if (strcmp(expected, buf) == 0){
+		printf("stock state matches %s\n", filename);
+		return 0;
+	}
+	printf("stock state differs from %s\n--- expected\n%s--- server\n%s", filename, expected, buf);
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	char *host, *port, *check_file = NULL;
+	int fast = 0, opt, ret;
+	struct replay_conn* conns = NULL;
+	unsigned nconns = 0, nreqs = 0;
+	struct trace_rec rec;
+	struct timespec start;
+	char buf[MAXLINE];
+	FILE* fp;
+
+	while ((opt = getopt(argc, argv, "fc:")) != -1){
+		if (opt == 'f') fast = 1;
+		else if (opt == 'c') check_file = optarg;
+		else argc = 0;
+	}
+	if (argc - optind != 3) {
+		fprintf(stderr, "usage: %s [-f] [-c stock.txt] <host> <port> <trace>\n", argv[0]);
+		fprintf(stderr, "  -f  replay as fast as possible instead of at original speed\n");
+		fprintf(stderr, "  -c  compare final stock state with given file\n");
+		exit(0);
+	}
+	host = argv[optind];
+	port = argv[optind + 1];
+	if ((fp = trace_open_read(argv[optind + 2])) == NULL) exit(1);
+
+	rec.ts_us = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while ((ret = trace_read(fp, &rec)) == 1){
+		if (rec.conn_id >= nconns){
+			unsigned n = rec.conn_id + 1 > nconns * 2 ? rec.conn_id + 1 : nconns * 2;
+			conns = Realloc(conns, n * sizeof(struct replay_conn));
+			for (unsigned i = nconns; i < n; i++) conns[i].fd = -1;
+			nconns = n;
+		}
+		struct replay_conn* c = &conns[rec.conn_id];
+
+		if (!fast) wait_until(&start, rec.ts_us);
+		if (rec.len == 0){	// client closed connection
+			if (c->fd >= 0) Close(c->fd);
+			c->fd = -1;
+			continue;
+		}
+		if (c->fd < 0){
+			c->fd = Open_clientfd(host, port);
+			Rio_readinitb(&c->rio, c->fd);
+		}
+		Rio_writen(c->fd, rec.data, rec.len);
+		nreqs++;
+		if (strncmp(rec.data, "exit", 4) == 0) continue;	// the event-based server replies nothing to exit
+		Rio_readnb(&c->rio, buf, MAXLINE);
+	}
+	if (ret < 0) fprintf(stderr, "Error: Corrupt trace record after %u requests\n", nreqs);
+	fclose(fp);
+
+	double secs = elapsed(&start);
+	for (unsigned i = 0; i < nconns; i++)
+		if (conns[i].fd >= 0) Close(conns[i].fd);
+	Free(conns);
+	printf("replayed %u requests in %.3fs (%.0f req/s)\n", nreqs, secs, secs > 0 ? nreqs / secs : 0.0);
+
+	if (check_file && check_stock(host, port, check_file) < 0) exit(1);
+	return 0;
+}
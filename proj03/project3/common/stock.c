@@ -0,0 +1,177 @@
+/*
+ * stock.c - stock table and request handling shared by the stock servers
+ *
+ * The stocks live in an array-based binary search tree loaded from and saved
+ * to stock.txt. Each stock has its own semaphore, so the thread-based server
+ * can run requests on different stocks in parallel.
+ */
+#include "csapp.h"
+#include "trace.h"
+#include "stock.h"
+
+struct stock* tree[MAX_STOCK_NUM];		// tree that saves stock structs
+int stock_num = 0;
+volatile sig_atomic_t sigint_received = 0;
+
+static int left(int i) {return 2*i + 1;}
+static int right(int i) {return 2*i + 2;}
+
+void stock_load(const char* filename){
+	stock_num = 0;
+	FILE* fp = fopen(filename, "r");
+	if (!fp){
+		fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+		return;
+	}
+	
+	// file read loop until EOF
+	int id, amount, price;
+	while (fscanf(fp, "%d %d %d\n", &id, &amount, &price) != EOF){
+		struct stock* tmp = Malloc(sizeof(struct stock));
+		tmp->id = id;
+		tmp->amount = amount;
+		tmp->price = price;
+		Sem_init(&tmp->mutex, 0, 1);
+		insert_tree(tmp);
+	} 
+	fclose(fp);
+	return;
+}
+
+void stock_save(const char* filename){
+	FILE* fp = fopen(filename, "w");
+	if (!fp){
+		fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+		return;
+	}
+	for (int i = 0; i < MAX_STOCK_NUM; i++){
+		if(tree[i])
+		fprintf(fp, "%d %d %d\n", tree[i]->id, tree[i]->amount, tree[i]->price);
+	}	
+	fclose(fp);
+	return;
+}
+
+// inserts new stock struct to tree and updates stock_num
+void insert_tree(struct stock* stock){
+	int index = 0;
+
+	if (stock_num >= MAX_STOCK_NUM){
+		fprintf(stderr, "Error: Tree full\n");
+		return;
+	}
+	
+	while (index < MAX_STOCK_NUM){
+		if (!tree[index]){
+			tree[index] = stock;
+			stock_num++;
+			return;
+		}
+		if (stock->id < tree[index]->id){
+			index = left(index);
+		}
+		else index = right(index);
+		if (index > MAX_STOCK_NUM){
+			fprintf(stderr, "Error: Tree full\n");
+			return;
+		}
+	}
+}
+
+// print to buf instead of stdout directly (for multi-thread safety)
+void print_tree(char* buf){
+	static char stock_info[64];
+	buf[0] = '\0';
+	
+	for (int i = 0; i < MAX_STOCK_NUM; i++){
+		if (tree[i]){
+		sprintf(stock_info, "%d %d %d\n", tree[i]->id, tree[i]->amount, tree[i]->price);
+		strcat(buf, stock_info);
+		}
+	}
+	return;
+}
+
+// searches tree by id. Returns NULL if not found
+struct stock* search_tree(int id){
+	int index = 0;
+	
+	if (stock_num == 0) return NULL;
+	while(index < MAX_STOCK_NUM){
+		if (!tree[index]) return NULL;
+		if (tree[index]->id == id)
+			return tree[index];
+		else if (id < tree[index]->id){
+			index = left(index);
+		}
+		else index = right(index);
+		if (index >= MAX_STOCK_NUM)
+			return NULL;
+	}
+	return NULL;	// shouldn't be here
+}
+
+// When receiving SIGINT(Ctrl-C), only raises a flag: saving the tree and closing the
+// trace take locks and stdio, which a handler can't use, so the main loop does it.
+void sigint_handler(int sig){
+	sigint_received = 1;
+}
+
+// Saves tree to file and exits (main loop, after SIGINT).
+void stock_exit(void){
+	stock_save("stock.txt");
+	trace_close();
+	for (int i = 0; i < MAX_STOCK_NUM; i++){
+		if (tree[i]) Free(tree[i]);
+	}
+	printf("Saved to stock.txt and exiting\n");
+	exit(0);
+}
+
+void process_request(int connfd, char* request){
+	char response[MAXLINE];
+	int id, amount;
+
+	printf("Server received %zu bytes\n", strlen(request));
+	if (strncmp(request, "show", 4) == 0){
+		request[0] = '\0';
+		print_tree(response);
+		strcpy(request, response);
+		//printf("handled show\n");
+		return;
+	}
+	else if (strncmp(request, "buy", 3) == 0 && sscanf(request, "%*s %d %d\n", &id, &amount) == 2){
+		struct stock* stock = search_tree(id);
+
+		if (stock){
+			P(&stock->mutex);		// critical section (handling shared resource)
+			if (amount <= stock->amount){
+				stock->amount -= amount;
+				strcpy(response, "[buy] success\n");
+			}
+			else strcpy(response, "Not enough left stock\n");
+			V(&stock->mutex);
+			strcpy(request, response);
+		//printf("handled buy\n");
+		}
+		return;
+	}
+	else if (strncmp(request, "sell", 4) == 0 && sscanf(request, "%*s %d %d\n", &id, &amount) == 2){
+		struct stock* stock = search_tree(id);
+
+		if (stock){
+			P(&stock->mutex);		// critical section (handling shared resource)
+			stock->amount += amount;
+			strcpy(response, "[sell] success\n");
+			V(&stock->mutex);
+			strcpy(request, response);
+		//printf("handled sell\n");
+		}
+		return;
+	}
+	else if (strncmp(request, "exit", 4) == 0){
+		return;	// closing connfd is left to the server (in case of abrupt client disconnection)
+	}
+
+	return;
+}
@@ -0,0 +1,36 @@
+/*
+ * stock.h - stock table and request handling shared by the stock servers
+ */
+#ifndef __STOCK_H__
+#define __STOCK_H__
+
+#include <signal.h>
+#include <semaphore.h>
+
+#define MAX_STOCK_NUM 128
+
+struct stock{ 
+	int id;
+	int amount;
+	int price;
+	sem_t mutex;
+};
+
+extern struct stock* tree[MAX_STOCK_NUM];		// tree that saves stock structs
+extern int stock_num;
+extern volatile sig_atomic_t sigint_received;	// set by sigint_handler, checked by the main loop
+
+void insert_tree(struct stock* stock);
+void print_tree(char* buf);
+struct stock* search_tree(int id);
+
+void stock_load(const char* filename);
+void stock_save(const char* filename);
+
+// replaces request with its response, or leaves it as is (e.g. "exit")
+void process_request(int connfd, char* request);
+
+void sigint_handler(int sig);
+void stock_exit(void);
+
+#endif /* __STOCK_H__ */
@@ -0,0 +1,113 @@
+/*
+ * trace.c - compact binary request trace for stockserver record/replay
+ *
+ * File layout: TRACE_MAGIC, then one record per inbound request
+ *   [ varint delta_us | varint conn_id | varint len | len bytes of request ]
+ * delta_us is the time since the previous record, so a typical record
+ * costs 3 bytes + the request line itself.
+ */
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+
+static FILE* trace_fp = NULL;		// NULL if not recording
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long long trace_start_us, trace_last_us;
+static unsigned next_conn_id = 0;
+
+static unsigned long long now_us(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// LEB128 encoding: 7 bits per byte, MSB set if more bytes follow
+static void put_varint(FILE* fp, unsigned long long v){
+	while (v >= 0x80){
+		fputc((int)(v & 0x7f) | 0x80, fp);
+		v >>= 7;
+	}
+	fputc((int) v, fp);
+}
+
+static int get_varint(FILE* fp, unsigned long long* v){
+	int c, shift = 0;
+	*v = 0;
+	do {
+		if ((c = fgetc(fp)) == EOF || shift > 63) return -1;
+		*v |= (unsigned long long)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return 0;
+}
+
+int trace_open_write(const char* filename){
+	if ((trace_fp = fopen(filename, "wb")) == NULL){
+		fprintf(stderr, "Error: Failed to open trace file: %s\n", filename);
+		return -1;
+	}
+	fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace_fp);
+	trace_start_us = trace_last_us = now_us();
+	return 0;
+}
+
+// returns a fresh connection id (ids are never reused, unlike fds)
+unsigned trace_new_conn(void){
+	return __sync_fetch_and_add(&next_conn_id, 1);
+}
+
+void trace_record(unsigned conn_id, const char* req, unsigned len){
+	unsigned long long now;
+
+	if (!trace_fp) return;
+	pthread_mutex_lock(&trace_lock);
+	now = now_us();
+	put_varint(trace_fp, now - trace_last_us);
+	put_varint(trace_fp, conn_id);
+	put_varint(trace_fp, len);
+	fwrite(req, 1, len, trace_fp);
+	trace_last_us = now;
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_close(void){
+	if (!trace_fp) return;
+	pthread_mutex_lock(&trace_lock);
+	fclose(trace_fp);
+	trace_fp = NULL;
+	pthread_mutex_unlock(&trace_lock);
+}
+
+FILE* trace_open_read(const char* filename){
+	char magic[sizeof(TRACE_MAGIC)] = { '\0' };
+	FILE* fp = fopen(filename, "rb");
+
+	if (!fp){
+		fprintf(stderr, "Error: Failed to open trace file: %s\n", filename);
+		return NULL;
+	}
+	if (fread(magic, 1, strlen(TRACE_MAGIC), fp) != strlen(TRACE_MAGIC) || strcmp(magic, TRACE_MAGIC)){
+		fprintf(stderr, "Error: Not a stock trace: %s\n", filename);
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+// reads next record into rec (timestamps accumulated). Returns 1 on success, 0 on EOF, -1 if corrupt
+int trace_read(FILE* fp, struct trace_rec* rec){
+	unsigned long long delta, conn_id, len;
+	int c;
+
+	if ((c = fgetc(fp)) == EOF) return 0;
+	ungetc(c, fp);
+	if (get_varint(fp, &delta) || get_varint(fp, &conn_id) || get_varint(fp, &len)) return -1;
+	if (len >= TRACE_MAXLEN) return -1;
+	if (fread(rec->data, 1, len, fp) != len) return -1;
+	rec->data[len] = '\0';
+	rec->ts_us += delta;
+	rec->conn_id = (unsigned) conn_id;
+	rec->len = (unsigned) len;
+	return 1;
+}
@@ -0,0 +1,30 @@
+/*
+ * trace.h - compact binary request trace for stockserver record/replay
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+
+#define TRACE_MAGIC "STKTRC01"
+#define TRACE_MAXLEN 8192	// same as MAXLINE, longest request line
+
+// one inbound request (len == 0 marks the client closing the connection)
+struct trace_rec {
+	unsigned long long ts_us;	// microseconds since recording started
+	unsigned conn_id;			// connection id, in order of first request
+	unsigned len;
+	char data[TRACE_MAXLEN];
+};
+
+// recording side (server): no-ops unless trace_open_write() succeeded
+int trace_open_write(const char* filename);
+unsigned trace_new_conn(void);
+void trace_record(unsigned conn_id, const char* req, unsigned len);
+void trace_close(void);
+
+// replay side
+FILE* trace_open_read(const char* filename);
+int trace_read(FILE* fp, struct trace_rec* rec);
+
+#endif /* __TRACE_H__ */
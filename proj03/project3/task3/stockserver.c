@@ -0,0 +1,296 @@
+/* 
+ * stockserver.c - io_uring-based concurrent stock server 
+ */ 
+/* $begin echoserverimain */
+#include "csapp.h"
+#include <stdint.h>
+#include "uring.h"
+#include "trace.h"
+#include "stock.h"
+
+#define MAX_CONNS 65536		// connection slots, indexed by connfd
+#define RING_ENTRIES 4096	// submission queue depth
+#define NBUFS 1024			// provided recv buffers (power of 2)
+#define BUF_SIZE 2048		// size of each provided recv buffer
+#define BGID 0				// provided buffer group id
+
+// operation tag kept in the low 2 bits of user_data
+#define OP_ACCEPT 0
+#define OP_RECV 1
+#define OP_SEND 2
+#define OP_CLOSE 3
+#define OP_MASK 3
+
+struct send_req {
+	struct send_req* next;
+	int connfd;
+	unsigned off;		// bytes of buf already sent
+	char buf[MAXLINE];	// response, sent as a fixed MAXLINE record like the other servers
+};
+
+struct conn {
+	int connfd;
+	unsigned conn_id;	// connection id for request tracing
+	int inflight;		// submitted sends not yet completed
+	int closing;		// recv has terminated, close once sends drain
+	int failed;			// a send failed, drop the remaining responses
+	struct send_req* head;	// responses waiting for the inflight chain to finish
+	struct send_req* tail;
+	struct send_req* rhead;	// sends of the inflight chain that were cut short, in order
+	struct send_req* rtail;
+	size_t len;			// bytes of a partial request line in line[]
+	char line[MAXLINE];
+};
+
+struct uring ring;
+struct uring_bufs bufs;
+struct conn* conns[MAX_CONNS];
+struct send_req* free_reqs = NULL;	// recycled send_req structs
+
+void echo(int connfd);
+
+struct io_uring_sqe* get_sqe(unsigned n);
+void arm_accept(int listenfd);
+void arm_recv(int connfd);
+void flush_sends(struct conn* c);
+void free_sends(struct conn* c);
+void close_conn(struct conn* c);
+void handle_accept(struct io_uring_cqe* cqe, int listenfd);
+void handle_recv(struct io_uring_cqe* cqe, int connfd);
+void handle_send(struct io_uring_cqe* cqe, struct send_req* req);
+void handle_close(int connfd);
+
+// returns an sqe, submitting queued ones first if fewer than n slots are free
+// (so that a linked chain of n sqes is never split across submissions)
+struct io_uring_sqe* get_sqe(unsigned n){
+	unsigned head = __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+	struct io_uring_sqe* sqe;
+
+	if (*ring.sq_mask + 1 - (ring.sqe_tail - head) < n)
+		uring_submit_and_wait(&ring, 0, NULL);
+	while ((sqe = uring_get_sqe(&ring)) == NULL)
+		uring_submit_and_wait(&ring, 0, NULL);
+	return sqe;
+}
+
+// one multishot accept keeps posting a completion per new connection
+void arm_accept(int listenfd){
+	struct io_uring_sqe* sqe = get_sqe(1);
+
+	uring_prep_multishot_accept(sqe, listenfd);
+	sqe->user_data = ((__u64) listenfd << 2) | OP_ACCEPT;
+}
+
+// one multishot recv per connection, kernel picks a buffer from the provided ring
+void arm_recv(int connfd){
+	struct io_uring_sqe* sqe = get_sqe(1);
+
+	uring_prep_multishot_recv(sqe, connfd, BGID);
+	sqe->user_data = ((__u64) connfd << 2) | OP_RECV;
+}
+
+// submits all queued responses of c as one linked chain so they go out in order
+void flush_sends(struct conn* c){
+	struct send_req* req;
+	unsigned n = 0;
+
+	for (req = c->head; req; req = req->next) n++;
+	while ((req = c->head) != NULL){
+		struct io_uring_sqe* sqe = get_sqe(n--);
+
+		c->head = req->next;
+		uring_prep_send(sqe, c->connfd, req->buf + req->off, MAXLINE - req->off);
+		sqe->user_data = (__u64)(uintptr_t) req | OP_SEND;
+		if (c->head) sqe->flags |= IOSQE_IO_LINK;
+		c->inflight++;
+	}
+	c->tail = NULL;
+}
+
+// drops the queued responses of c
+void free_sends(struct conn* c){
+	struct send_req* req;
+
+	while ((req = c->head) != NULL){
+		c->head = req->next;
+		req->next = free_reqs;
+		free_reqs = req;
+	}
+	c->tail = NULL;
+}
+
+void close_conn(struct conn* c){
+	struct io_uring_sqe* sqe = get_sqe(1);
+
+	uring_prep_close(sqe, c->connfd);
+	sqe->user_data = ((__u64) c->connfd << 2) | OP_CLOSE;
+}
+
+void handle_accept(struct io_uring_cqe* cqe, int listenfd){
+	int connfd = cqe->res;
+
+	if (!(cqe->flags & IORING_CQE_F_MORE)) arm_accept(listenfd);	// multishot terminated, re-arm
+	if (connfd < 0) return;
+	if (connfd >= MAX_CONNS){
+		fprintf(stderr, "Error: Maximum number of clients reached.\n");
+		close(connfd);
+		return;
+	}
+	struct conn* c = Malloc(sizeof(struct conn));
+	c->connfd = connfd;
+	c->conn_id = trace_new_conn();
+	c->inflight = 0;
+	c->closing = 0;
+	c->failed = 0;
+	c->head = c->tail = NULL;
+	c->rhead = c->rtail = NULL;
+	c->len = 0;
+	conns[connfd] = c;
+	printf("Connected (fd %d)\n", connfd);
+	arm_recv(connfd);
+}
+
+// splits received bytes into request lines and queues one response per line
+void handle_recv(struct io_uring_cqe* cqe, int connfd){
+	struct conn* c = conns[connfd];
+	int more = cqe->flags & IORING_CQE_F_MORE;
+
+	if (cqe->flags & IORING_CQE_F_BUFFER){
+		unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		char* data = uring_bufs_get(&bufs, bid);
+
+		for (int i = 0; i < cqe->res; i++){
+			c->line[c->len++] = data[i];
+			if (data[i] != '\n' && c->len < MAXLINE - 1) continue;
+
+			// full line (or MAXLINE-1 bytes, as Rio_readlineb does): handle like the other servers
+			struct send_req* req = free_reqs;
+			if (req) free_reqs = req->next;
+			else req = Malloc(sizeof(struct send_req));
+			memcpy(req->buf, c->line, c->len);
+			trace_record(c->conn_id, c->line, c->len);
+			memset(req->buf + c->len, 0, MAXLINE - c->len);
+			c->len = 0;
+			req->connfd = connfd;
+			req->off = 0;
+			req->next = NULL;
+			process_request(connfd, req->buf);
+			if (c->tail) c->tail->next = req;
+			else c->head = req;
+			c->tail = req;
+		}
+		uring_bufs_recycle(&bufs, bid);
+	}
+	if (c->failed) free_sends(c);
+	if (c->head && c->inflight == 0) flush_sends(c);
+
+	if (more) return;
+	if (cqe->res > 0 || cqe->res == -ENOBUFS){	// multishot ended (e.g. out of provided buffers, recycled above), re-arm
+		arm_recv(connfd);
+		return;
+	}
+	// EOF or error: connection closed by client
+	trace_record(c->conn_id, c->line, 0);
+	c->closing = 1;
+	if (c->inflight == 0 && !c->head) close_conn(c);
+}
+
+// a short send breaks the link, so it and the sends cancelled after it go out again in order
+void handle_send(struct io_uring_cqe* cqe, struct send_req* req){
+	struct conn* c = conns[req->connfd];
+	int res = cqe->res;
+
+	if (res > 0) req->off += res;
+	if (!c->failed && (res == -ECANCELED || (res >= 0 && req->off < MAXLINE))){
+		req->next = NULL;
+		if (c->rtail) c->rtail->next = req;
+		else c->rhead = req;
+		c->rtail = req;
+	}
+	else {
+		if (res < 0 && res != -ECANCELED && !c->failed){	// peer is gone: end the recv too, it closes the connection
+			c->failed = 1;
+			shutdown(c->connfd, SHUT_RDWR);
+		}
+		req->next = free_reqs;
+		free_reqs = req;
+	}
+	if (--c->inflight > 0) return;
+
+	if (c->rhead){
+		c->rtail->next = c->head;
+		if (!c->head) c->tail = c->rtail;
+		c->head = c->rhead;
+		c->rhead = c->rtail = NULL;
+	}
+	if (c->failed) free_sends(c);
+	if (c->head) flush_sends(c);
+	else if (c->closing) close_conn(c);
+}
+
+void handle_close(int connfd){
+	struct send_req* req;
+
+	while ((req = conns[connfd]->head) != NULL){
+		conns[connfd]->head = req->next;
+		Free(req);
+	}
+	Free(conns[connfd]);
+	conns[connfd] = NULL;
+}
+
+int main(int argc, char **argv) 
+{
+    int listenfd, ret;
+	struct io_uring_cqe* cqe;
+	sigset_t intmask, waitmask;
+
+    if (argc != 2 && !(argc == 4 && strcmp(argv[2], "-r") == 0)) {
+	fprintf(stderr, "usage: %s <port> [-r trace]\n", argv[0]);
+	exit(0);
+    }
+	if (argc == 4 && trace_open_write(argv[3]) < 0)	// record every request for replay
+		exit(1);
+	
+	Signal(SIGINT, sigint_handler);
+	Sigemptyset(&intmask);
+	Sigaddset(&intmask, SIGINT);
+	Sigprocmask(SIG_BLOCK, &intmask, &waitmask);	// SIGINT only arrives while the main loop waits
+
+	// init tree with nullptr, then create tree by reading from filename
+	for (int i = 0; i < MAX_STOCK_NUM; i++)
+		tree[i] = NULL;
+	stock_load("stock.txt");
+
+	if ((ret = uring_init(&ring, RING_ENTRIES)) < 0)
+		posix_error(-ret, "io_uring_setup error");
+	if ((ret = uring_bufs_init(&ring, &bufs, NBUFS, BUF_SIZE, BGID)) < 0)
+		posix_error(-ret, "provided buffer ring error");
+
+    listenfd = Open_listenfd(argv[1]);
+	arm_accept(listenfd);
+    while (!sigint_received) {
+		// one syscall both submits new sqes and waits for completions, SIGINT unblocked
+		ret = uring_submit_and_wait(&ring, 1, &waitmask);
+		if (ret < 0 && ret != -EINTR && ret != -EBUSY)
+			posix_error(-ret, "io_uring_enter error");
+
+		while ((cqe = uring_peek_cqe(&ring)) != NULL){
+			__u64 data = cqe->user_data;
+
+			switch (data & OP_MASK){
+			case OP_ACCEPT: handle_accept(cqe, (int)(data >> 2)); break;
+			case OP_RECV: handle_recv(cqe, (int)(data >> 2)); break;
+			case OP_SEND: handle_send(cqe, (struct send_req*)(uintptr_t)(data & ~(__u64) OP_MASK)); break;
+			case OP_CLOSE: handle_close((int)(data >> 2)); break;
+			}
+			uring_cqe_seen(&ring);
+		}
+		uring_bufs_advance(&bufs);	// hand recycled buffers back in one store
+    }
+	Close(listenfd);
+	uring_exit(&ring);
+	stock_exit();
+    return 0;
+}
+/* $end echoserverimain */
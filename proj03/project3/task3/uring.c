@@ -0,0 +1,199 @@
+/*
+ * uring.c - minimal io_uring wrapper on top of the raw syscalls
+ */
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+#define load_acquire(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static int sys_uring_setup(unsigned entries, struct io_uring_params *p){
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const sigset_t *sig){
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, sig, sig ? _NSIG / 8 : 0);
+}
+
+static int sys_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args){
+	return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// creates ring with given setup flags and maps SQ/CQ rings and sqe array
+static int uring_setup(struct uring *ring, unsigned entries, unsigned flags){
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = flags;
+	ring->fd = sys_uring_setup(entries, &p);
+	if (ring->fd < 0) return -errno;
+	ring->flags = flags;
+
+	ring->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP){
+		if (ring->cq_ring_sz > ring->sq_ring_sz) ring->sq_ring_sz = ring->cq_ring_sz;
+		ring->cq_ring_sz = ring->sq_ring_sz;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_sz, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) goto fail;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) ring->cq_ring = ring->sq_ring;
+	else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_sz, PROT_READ | PROT_WRITE,
+							MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) goto fail;
+	}
+	ring->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) goto fail;
+
+	ring->sq_head = (unsigned *)((char *)ring->sq_ring + p.sq_off.head);
+	ring->sq_tail = (unsigned *)((char *)ring->sq_ring + p.sq_off.tail);
+	ring->sq_mask = (unsigned *)((char *)ring->sq_ring + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)((char *)ring->sq_ring + p.sq_off.array);
+	ring->sqe_tail = *ring->sq_tail;
+
+	ring->cq_head = (unsigned *)((char *)ring->cq_ring + p.cq_off.head);
+	ring->cq_tail = (unsigned *)((char *)ring->cq_ring + p.cq_off.tail);
+	ring->cq_mask = (unsigned *)((char *)ring->cq_ring + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ring + p.cq_off.cqes);
+	return 0;
+
+fail:
+	close(ring->fd);
+	return -errno;
+}
+
+// inits ring, preferring single issuer + deferred task work (kernel >= 6.1)
+int uring_init(struct uring *ring, unsigned entries){
+	memset(ring, 0, sizeof(*ring));
+	if (uring_setup(ring, entries, IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN) == 0)
+		return 0;
+	return uring_setup(ring, entries, 0);
+}
+
+void uring_exit(struct uring *ring){
+	munmap(ring->sqes, ring->sqes_sz);
+	if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_sz);
+	munmap(ring->sq_ring, ring->sq_ring_sz);
+	close(ring->fd);
+}
+
+// returns next free sqe, or NULL if submission queue is full
+struct io_uring_sqe *uring_get_sqe(struct uring *ring){
+	unsigned head = load_acquire(ring->sq_head);
+	struct io_uring_sqe *sqe;
+
+	if (ring->sqe_tail - head > *ring->sq_mask) return NULL;
+	sqe = &ring->sqes[ring->sqe_tail & *ring->sq_mask];
+	ring->sq_array[ring->sqe_tail & *ring->sq_mask] = ring->sqe_tail & *ring->sq_mask;
+	ring->sqe_tail++;
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+// publishes queued sqes and waits for wait_nr completions in a single syscall;
+// with a sigmask the wait runs under it as in pselect(), and a signal returns -EINTR
+int uring_submit_and_wait(struct uring *ring, unsigned wait_nr, const sigset_t *sigmask){
+	unsigned to_submit = ring->sqe_tail - load_acquire(ring->sq_head);	// includes any left by an interrupted call
+	unsigned flags = 0;
+	int ret;
+
+	store_release(ring->sq_tail, ring->sqe_tail);
+	if (wait_nr || (ring->flags & IORING_SETUP_DEFER_TASKRUN)) flags |= IORING_ENTER_GETEVENTS;
+	if (!to_submit && !wait_nr) return 0;
+	do {
+		ret = sys_uring_enter(ring->fd, to_submit, wait_nr, flags, sigmask);
+	} while (ret < 0 && errno == EINTR && !sigmask);
+	return ret < 0 ? -errno : ret;
+}
+
+// returns next completion without blocking, or NULL if none
+struct io_uring_cqe *uring_peek_cqe(struct uring *ring){
+	unsigned head = *ring->cq_head;
+
+	if (head == load_acquire(ring->cq_tail)) return NULL;
+	return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(struct uring *ring){
+	store_release(ring->cq_head, *ring->cq_head + 1);
+}
+
+// registers a ring of nbufs provided buffers (nbufs must be a power of 2) under group bgid
+int uring_bufs_init(struct uring *ring, struct uring_bufs *bufs, unsigned nbufs, unsigned buf_size, unsigned short bgid){
+	struct io_uring_buf_reg reg;
+	size_t ring_sz = nbufs * sizeof(struct io_uring_buf);
+
+	bufs->br = mmap(NULL, ring_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (bufs->br == MAP_FAILED) return -errno;
+	bufs->base = mmap(NULL, (size_t) nbufs * buf_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (bufs->base == MAP_FAILED) return -errno;
+	bufs->nbufs = nbufs;
+	bufs->buf_size = buf_size;
+	bufs->bgid = bgid;
+	bufs->tail = 0;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long) bufs->br;
+	reg.ring_entries = nbufs;
+	reg.bgid = bgid;
+	if (sys_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return -errno;
+
+	for (unsigned i = 0; i < nbufs; i++) uring_bufs_recycle(bufs, i);
+	uring_bufs_advance(bufs);
+	return 0;
+}
+
+// hands buffer bid back to the kernel (visible after uring_bufs_advance)
+void uring_bufs_recycle(struct uring_bufs *bufs, unsigned short bid){
+	struct io_uring_buf *buf = &bufs->br->bufs[bufs->tail & (bufs->nbufs - 1)];
+
+	buf->addr = (unsigned long) uring_bufs_get(bufs, bid);
+	buf->len = bufs->buf_size;
+	buf->bid = bid;
+	bufs->tail++;
+}
+
+void uring_bufs_advance(struct uring_bufs *bufs){
+	store_release(&bufs->br->tail, bufs->tail);
+}
+
+char *uring_bufs_get(struct uring_bufs *bufs, unsigned short bid){
+	return bufs->base + (size_t) bid * bufs->buf_size;
+}
+
+void uring_prep_multishot_accept(struct io_uring_sqe *sqe, int fd){
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+}
+
+void uring_prep_multishot_recv(struct io_uring_sqe *sqe, int fd, unsigned short bgid){
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bgid;
+}
+
+void uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *buf, unsigned len){
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long) buf;
+	sqe->len = len;
+	sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;	// kernel retries short sends
+}
+
+void uring_prep_close(struct io_uring_sqe *sqe, int fd){
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = fd;
+}
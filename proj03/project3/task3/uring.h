@@ -0,0 +1,65 @@
+/*
+ * uring.h - minimal io_uring wrapper on top of the raw syscalls
+ * (no liburing dependency, needs kernel >= 6.0 for multishot recv)
+ */
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <stddef.h>
+#include <signal.h>
+#include <linux/io_uring.h>
+
+struct uring {
+	int fd;
+	unsigned flags;		// setup flags the ring was created with
+
+	// submission queue (shared with kernel)
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned sqe_tail;	// local tail, published to sq_tail on submit
+
+	// completion queue (shared with kernel)
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ring;
+	size_t sq_ring_sz;
+	void *cq_ring;
+	size_t cq_ring_sz;
+	size_t sqes_sz;
+};
+
+// provided buffer ring: kernel picks a buffer from here for each recv
+struct uring_bufs {
+	struct io_uring_buf_ring *br;
+	char *base;		// nbufs * buf_size bytes of backing storage
+	unsigned nbufs;
+	unsigned buf_size;
+	unsigned short bgid;
+	unsigned short tail;	// local tail, published on uring_bufs_advance
+};
+
+int uring_init(struct uring *ring, unsigned entries);
+void uring_exit(struct uring *ring);
+struct io_uring_sqe *uring_get_sqe(struct uring *ring);
+int uring_submit_and_wait(struct uring *ring, unsigned wait_nr, const sigset_t *sigmask);
+struct io_uring_cqe *uring_peek_cqe(struct uring *ring);
+void uring_cqe_seen(struct uring *ring);
+
+int uring_bufs_init(struct uring *ring, struct uring_bufs *bufs, unsigned nbufs, unsigned buf_size, unsigned short bgid);
+void uring_bufs_recycle(struct uring_bufs *bufs, unsigned short bid);
+void uring_bufs_advance(struct uring_bufs *bufs);
+char *uring_bufs_get(struct uring_bufs *bufs, unsigned short bid);
+
+// sqe preparation helpers
+void uring_prep_multishot_accept(struct io_uring_sqe *sqe, int fd);
+void uring_prep_multishot_recv(struct io_uring_sqe *sqe, int fd, unsigned short bgid);
+void uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *buf, unsigned len);
+void uring_prep_close(struct io_uring_sqe *sqe, int fd);
+
+#endif /* __URING_H__ */
@@ -0,0 +1,125 @@
+/*
+ * mdebug.c - checks that the hardened mode of mm.c (-DMM_DEBUG) catches misuse
+ *
+ * Each case misuses a block in a child process, which must abort with the
+ * report mm.c prints for that kind of misuse on stderr.
+ *
+ * usage: mdebug
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define MAXLINE 1024
+#define EVICT_BLOCKS 4096   /* more frees than the quarantine holds */
+
+static void double_free(void)
+{
+    char *p = mm_malloc(32);
+    mm_free(p);
+    mm_free(p);
+}
+
+static void overflow(void)
+{
+    volatile char *p = mm_malloc(32);
+    p[32] = 'x';
+    mm_free((char *)p);
+}
+
+static void invalid_free(void)
+{
+    char *p = mm_malloc(64);
+    mm_free(p + 16);
+}
+
+/* the write is found when the block leaves the quarantine */
+static void write_after_free(void)
+{
+    volatile char *p = mm_malloc(32);
+    mm_free((char *)p);
+    p[0] = 'x';
+    for (int i = 0; i < EVICT_BLOCKS; i++)
+        mm_free(mm_malloc(32));
+}
+
+typedef struct {
+    char *name;
+    void (*run)(void);
+    char *report;           /* expected on stderr */
+} case_t;
+
+static const case_t cases[] = {
+    { "double free", double_free, "mm: double free" },
+    { "overflow", overflow, "mm: buffer overflow" },
+    { "invalid free", invalid_free, "mm: invalid free" },
+    { "write after free", write_after_free, "mm: write after free" },
+};
+
+/*
+ * run_case - run c in a child and check that it aborts with c's report
+ */
+static int run_case(const case_t *c)
+{
+    char out[MAXLINE];
+    size_t len = 0;
+    ssize_t n;
+    int fds[2], status;
+    pid_t pid;
+
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);         /* or the child prints it again when it exits */
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        struct rlimit nocore = { 0, 0 };
+        setrlimit(RLIMIT_CORE, &nocore);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        mem_init();
+        if (mm_init() < 0) exit(2);
+        c->run();
+        exit(0);
+    }
+    close(fds[1]);
+    while ((n = read(fds[0], out + len, sizeof(out) - 1 - len)) > 0)
+        len += n;
+    out[len] = '\0';
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGABRT) {
+        fprintf(stderr, "%s: child didn't abort (status %#x)\n", c->name, status);
+        return 0;
+    }
+    if (strstr(out, c->report) == NULL) {
+        fprintf(stderr, "%s: expected \"%s\", got \"%s\"\n", c->name, c->report, out);
+        return 0;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        int ok = run_case(&cases[i]);
+        printf("%-20s %s\n", cases[i].name, ok ? "caught" : "FAILED");
+        failed += !ok;
+    }
+    return failed != 0;
+}
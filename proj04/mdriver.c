@@ -0,0 +1,592 @@
+/*
+ * mdriver.c - trace-driven driver for the mm.c allocator
+ *
+ * Replays malloc/free/realloc traces against mm_malloc/mm_free/mm_realloc.
+ * For each trace it
+ *   1. checks correctness: payloads are 8-byte aligned, lie inside the heap,
+ *      don't overlap (each payload is filled with a pattern that is checked
+ *      before it is freed or reallocated) and realloc keeps the old data,
+ *   2. measures peak utilization: max live payload bytes / max memory used
+ *      (sbrk heap plus separate mappings from mem_mmap),
+ *   3. measures throughput: the trace is replayed until at least
+ *      MIN_TIME seconds have passed, and ops/sec is reported.
+ * With -c mm_check runs after every request, and with -p the mm_profile of
+ * each trace is printed at the request where live payload peaks, and with -s
+ * the mm_stats counters are printed after each trace.
+ * With -a the traces are run once per placement policy (MM_POLICY), followed
+ * by a summary of the utilization/throughput tradeoff of each.
+ * Before the traces, requests too large to satisfy are checked to fail cleanly,
+ * mm_calloc to zero recycled heap and mm_memalign to align at 16 to 4096 bytes.
+ *
+ * usage: mdriver [-achpsv] [-t <tracedir>] [-f <tracefile>]...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define TRACEDIR "./traces/"
+#define MAXLINE 1024
+#define MAX_TRACES 64
+#define MIN_TIME 0.2        /* seconds spent timing each trace */
+#define ALIGNMENT 8
+
+/* default traces, in TRACEDIR */
+static char *default_tracefiles[] = {
+    "random.rep",
+    "random-small.rep",
+    "binary.rep",
+    "coalescing.rep",
+    "realloc.rep",
+    "small.rep",
+    "fragment.rep",
+    "large.rep",
+    NULL
+};
+
+typedef enum { ALLOC, FREE, REALLOC } optype_t;
+
+typedef struct {
+    optype_t type;          /* type of request */
+    int index;              /* block id */
+    size_t size;            /* byte size of alloc/realloc request */
+} traceop_t;
+
+typedef struct {
+    int num_ids;            /* number of alloc/realloc ids */
+    int num_ops;            /* number of distinct requests */
+    traceop_t *ops;         /* array of requests */
+    char **blocks;          /* payload pointer of each id */
+    size_t *block_sizes;    /* requested size of each id */
+} trace_t;
+
+typedef struct {
+    int valid;              /* trace ran correctly */
+    double util;            /* peak utilization */
+    double ops;             /* ops per replay */
+    double secs;            /* seconds per replay */
+} stats_t;
+
+static int verbose = 0;
+static int check = 0;       /* run mm_check after each request */
+static int profile = 0;     /* print mm_profile at peak live payload */
+static int print_stats = 0; /* print mm_stats after the correctness run */
+
+/* placement policies understood by mm_init, for -a */
+static char *policies[] = { "seg", "first", "next", "best", NULL };
+
+static void app_error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+static trace_t *read_trace(char *tracedir, char *filename)
+{
+    FILE *fp;
+    trace_t *trace;
+    char type[MAXLINE], path[MAXLINE];
+    int index, size, sugg_heapsize, weight, op_index = 0;
+
+    if ((trace = malloc(sizeof(trace_t))) == NULL)
+        app_error("malloc failed in read_trace");
+
+    snprintf(path, MAXLINE, "%s%s", tracedir, filename);
+    if ((fp = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Could not open %s in read_trace\n", path);
+        exit(1);
+    }
+    if (fscanf(fp, "%d %d %d %d", &sugg_heapsize, &trace->num_ids, &trace->num_ops, &weight) != 4)
+        app_error("Bad trace header");
+
+    trace->ops = malloc(trace->num_ops * sizeof(traceop_t));
+    trace->blocks = calloc(trace->num_ids, sizeof(char *));
+    trace->block_sizes = calloc(trace->num_ids, sizeof(size_t));
+    if (!trace->ops || !trace->blocks || !trace->block_sizes)
+        app_error("malloc failed in read_trace");
+
+    while (op_index < trace->num_ops && fscanf(fp, "%s", type) != EOF) {
+        traceop_t *op = &trace->ops[op_index];
+        switch (type[0]) {
+        case 'a':
+        case 'r':
+            if (fscanf(fp, "%d %d", &index, &size) != 2) app_error("Bad trace op");
+            op->type = type[0] == 'a' ? ALLOC : REALLOC;
+            op->size = size;
+            break;
+        case 'f':
+            if (fscanf(fp, "%d", &index) != 1) app_error("Bad trace op");
+            op->type = FREE;
+            break;
+        default:
+            fprintf(stderr, "Bogus type character (%c) in tracefile %s\n", type[0], path);
+            exit(1);
+        }
+        if (index < 0 || index >= trace->num_ids) app_error("Block id out of range");
+        op->index = index;
+        op_index++;
+    }
+    trace->num_ops = op_index;
+    fclose(fp);
+    return trace;
+}
+
+static void free_trace(trace_t *trace)
+{
+    free(trace->ops);
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);
+}
+
+/* fill byte of block id (never 0, so zeroed memory is caught too) */
+static unsigned char pattern(int index)
+{
+    return (unsigned char)(index % 255 + 1);
+}
+
+/*
+ * check_block - payload p of size bytes is aligned, inside the heap, and (if filled) intact
+ */
+static int check_block(char *tracename, int opnum, char *p, size_t size, int index, size_t filled)
+{
+    if ((uintptr_t)p % ALIGNMENT) {
+        fprintf(stderr, "%s: op %d: payload %p not aligned to %d bytes\n", tracename, opnum, p, ALIGNMENT);
+        return 0;
+    }
+    if ((p < (char *)mem_heap_lo() || p + size - 1 > (char *)mem_heap_hi()) && !mem_in_map(p, size)) {
+        fprintf(stderr, "%s: op %d: payload [%p:%p] outside heap [%p:%p]\n", tracename, opnum,
+                p, p + size - 1, mem_heap_lo(), mem_heap_hi());
+        return 0;
+    }
+    for (size_t i = 0; i < filled; i++) {
+        if ((unsigned char)p[i] != pattern(index)) {
+            fprintf(stderr, "%s: op %d: payload of block %d overwritten at byte %zu\n", tracename, opnum, index, i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * eval_mm_valid - check the allocator for correctness on a trace and compute its peak utilization
+ */
+static int eval_mm_valid(trace_t *trace, char *tracename, double *util, int *peak_op)
+{
+    size_t live = 0, max_live = 0, max_heap = 0, footprint;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "%s: mm_init failed\n", tracename);
+        return 0;
+    }
+    memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+
+    for (int i = 0; i < trace->num_ops; i++) {
+        traceop_t *op = &trace->ops[i];
+        int index = op->index;
+        char *oldp = trace->blocks[index], *p;
+        size_t oldsize = trace->block_sizes[index];
+
+        switch (op->type) {
+        case ALLOC:
+            if ((p = mm_malloc(op->size)) == NULL) {
+                fprintf(stderr, "%s: op %d: mm_malloc failed\n", tracename, i);
+                return 0;
+            }
+            if (!check_block(tracename, i, p, op->size, index, 0)) return 0;
+            memset(p, pattern(index), op->size);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = op->size;
+            live += op->size;
+            break;
+
+        case REALLOC:
+            if (oldp && !check_block(tracename, i, oldp, oldsize, index, oldsize)) return 0;
+            if ((p = mm_realloc(oldp, op->size)) == NULL) {
+                fprintf(stderr, "%s: op %d: mm_realloc failed\n", tracename, i);
+                return 0;
+            }
+            if (!check_block(tracename, i, p, op->size, index, oldsize < op->size ? oldsize : op->size)) {
+                fprintf(stderr, "%s: op %d: mm_realloc did not preserve the old block data\n", tracename, i);
+                return 0;
+            }
+            memset(p, pattern(index), op->size);
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = op->size;
+            live = live - oldsize + op->size;
+            break;
+
+        case FREE:
+            if (oldp && !check_block(tracename, i, oldp, oldsize, index, oldsize)) return 0;
+            mm_free(oldp);
+            trace->blocks[index] = NULL;
+            trace->block_sizes[index] = 0;
+            live -= oldsize;
+            break;
+        }
+
+        if (check && mm_check(0)) {
+            fprintf(stderr, "%s: op %d: mm_check failed\n", tracename, i);
+            return 0;
+        }
+        if (live > max_live) {
+            max_live = live;
+            *peak_op = i;
+        }
+        footprint = mem_heapsize() + mem_mapsize();
+        if (footprint > max_heap) max_heap = footprint;
+    }
+
+    *util = max_heap ? (double)max_live / max_heap : 0;
+    return 1;
+}
+
+/*
+ * replay - run the first num_ops requests of the trace without any checks
+ */
+static void replay(trace_t *trace, int num_ops)
+{
+    char **blocks = trace->blocks;
+
+    mem_reset_brk();
+    if (mm_init() < 0) app_error("mm_init failed");
+
+    for (int i = 0; i < num_ops; i++) {
+        traceop_t *op = &trace->ops[i];
+        switch (op->type) {
+        case ALLOC:
+            blocks[op->index] = mm_malloc(op->size);
+            break;
+        case REALLOC:
+            blocks[op->index] = mm_realloc(blocks[op->index], op->size);
+            break;
+        case FREE:
+            mm_free(blocks[op->index]);
+            blocks[op->index] = NULL;
+            break;
+        }
+    }
+}
+
+/*
+ * eval_mm_limits - check that requests too large to satisfy fail, and leave the heap
+ * and the block being reallocated intact (sizes a trace can't express)
+ */
+static int eval_mm_limits(void)
+{
+    static const size_t sizes[] = { 1, 100, 1 << 20 };     /* slab slot, heap block, mapping */
+    static const size_t huge[] = { SIZE_MAX, SIZE_MAX - 2, (size_t)PTRDIFF_MAX + 1 };
+    int valid = 1;
+
+    mem_reset_brk();
+    if (mm_init() < 0) app_error("mm_init failed");
+
+    for (int j = 0; j < (int)(sizeof(huge) / sizeof(huge[0])); j++) {
+        if (mm_malloc(huge[j]) != NULL) {
+            fprintf(stderr, "limits: mm_malloc of %zu bytes succeeded\n", huge[j]);
+            return 0;
+        }
+    }
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        char *p = mm_malloc(sizes[i]);
+        if (p == NULL) app_error("mm_malloc failed in eval_mm_limits");
+        memset(p, pattern(i), sizes[i]);
+        for (int j = 0; j < (int)(sizeof(huge) / sizeof(huge[0])); j++) {
+            if (mm_realloc(p, huge[j]) != NULL) {
+                fprintf(stderr, "limits: mm_realloc of a %zu byte block to %zu bytes succeeded\n",
+                        sizes[i], huge[j]);
+                return 0;
+            }
+            if (!check_block("limits", j, p, sizes[i], i, sizes[i]) || mm_check(0)) valid = 0;
+        }
+        mm_free(p);
+    }
+    if (!valid) fprintf(stderr, "limits: a failed mm_realloc damaged the block or the heap\n");
+    return valid;
+}
+
+/*
+ * eval_mm_zeroed - check that mm_calloc zeroes blocks carved from heap that was dirtied,
+ * freed and trimmed (so may keep its old contents), up to and across mem_heap_zero()
+ */
+static int eval_mm_zeroed(void)
+{
+    enum { NDIRTY = 48, DIRTY_SIZE = 8000, NZEROED = 8, ZEROED_SIZE = 100000 };
+    static const size_t others[] = { 100, 1 << 20 };          /* slab slot, mapping */
+    char *blocks[NDIRTY];
+    int valid = 1, n = 0;
+
+    mem_reset_brk();
+    if (mm_init() < 0) app_error("mm_init failed");
+
+    /* more than the trim threshold, so freeing it lowers the brk below mem_heap_zero() */
+    for (int i = 0; i < NDIRTY; i++) {
+        if ((blocks[i] = mm_malloc(DIRTY_SIZE)) == NULL) app_error("mm_malloc failed in eval_mm_zeroed");
+        memset(blocks[i], 0xff, DIRTY_SIZE);
+    }
+    for (int i = 0; i < NDIRTY; i++)
+        mm_free(blocks[i]);
+    if ((char *)mem_heap_hi() + 1 >= (char *)mem_heap_zero()) {
+        fprintf(stderr, "zeroed: freeing %d bytes didn't trim the heap\n", NDIRTY * DIRTY_SIZE);
+        return 0;
+    }
+
+    /* each block extends the heap, so one of them crosses mem_heap_zero() */
+    for (char *zero = NULL; n < NZEROED && (n == 0 || blocks[n - 1] + ZEROED_SIZE <= zero); n++) {
+        zero = mem_heap_zero();
+        if ((blocks[n] = mm_calloc(1, ZEROED_SIZE)) == NULL) app_error("mm_calloc failed in eval_mm_zeroed");
+    }
+    if (n == NZEROED) {
+        fprintf(stderr, "zeroed: no mm_calloc block crossed mem_heap_zero()\n");
+        valid = 0;
+    }
+    for (int i = 0; i < (int)(sizeof(others) / sizeof(others[0])); i++, n++)
+        if ((blocks[n] = mm_calloc(1, others[i])) == NULL) app_error("mm_calloc failed in eval_mm_zeroed");
+
+    for (int i = 0; i < n; i++) {
+        size_t size = i < n - 2 ? ZEROED_SIZE : others[i - (n - 2)];
+        for (size_t k = 0; k < size; k++) {
+            if (blocks[i][k]) {
+                fprintf(stderr, "zeroed: byte %zu of a %zu byte mm_calloc block is nonzero\n", k, size);
+                valid = 0;
+                break;
+            }
+        }
+        mm_free(blocks[i]);
+    }
+    if (mm_check(0)) valid = 0;
+    return valid;
+}
+
+/*
+ * eval_mm_aligned - check that mm_memalign aligns slab slots, heap blocks and mappings
+ * to 16 through 4096 bytes, and that they realloc and free intact
+ */
+static int eval_mm_aligned(void)
+{
+    static const size_t sizes[] = { 24, 200, 3000, 1 << 20 };  /* slab slots, heap block, mapping */
+    enum { NSIZES = sizeof(sizes) / sizeof(sizes[0]), NALIGNS = 9 };
+    char *blocks[NSIZES * NALIGNS];
+    int valid = 1;
+
+    mem_reset_brk();
+    if (mm_init() < 0) app_error("mm_init failed");
+
+    for (int i = 0; i < NSIZES * NALIGNS; i++) {
+        size_t align = (size_t)16 << (i % NALIGNS), size = sizes[i / NALIGNS];
+        char *p = mm_memalign(align, size);
+        if (p == NULL) app_error("mm_memalign failed in eval_mm_aligned");
+        if ((uintptr_t)p % align) {
+            fprintf(stderr, "aligned: mm_memalign(%zu, %zu) returned %p\n", align, size, p);
+            valid = 0;
+        }
+        memset(p, pattern(i), size);
+        blocks[i] = p;
+    }
+    if (mm_check(0)) valid = 0;
+    for (int i = 0; i < NSIZES * NALIGNS; i++) {
+        size_t size = sizes[i / NALIGNS];
+        if (!check_block("aligned", i, blocks[i], size, i, size)) valid = 0;
+        /* grow, then shrink below the original size: the payload may move, but survives */
+        char *p = mm_realloc(blocks[i], size * 2);
+        if (p == NULL) app_error("mm_realloc failed in eval_mm_aligned");
+        if (!check_block("aligned", i, p, size * 2, i, size)) valid = 0;
+        if ((p = mm_realloc(p, size / 2)) == NULL) app_error("mm_realloc failed in eval_mm_aligned");
+        if (!check_block("aligned", i, p, size / 2, i, size / 2)) valid = 0;
+        mm_free(p);
+    }
+    if (mm_check(0)) valid = 0;
+    return valid;
+}
+
+/*
+ * free_blocks - free the blocks a partial replay left live, so that their mappings
+ * don't count toward the footprint of the next trace (mm_init doesn't unmap them)
+ */
+static void free_blocks(trace_t *trace)
+{
+    for (int i = 0; i < trace->num_ids; i++) {
+        mm_free(trace->blocks[i]);
+        trace->blocks[i] = NULL;
+    }
+}
+
+/*
+ * eval_mm_speed - seconds per replay of the trace, averaged over at least MIN_TIME
+ */
+static double eval_mm_speed(trace_t *trace)
+{
+    int reps = 0;
+    double start = now(), elapsed;
+
+    do {
+        replay(trace, trace->num_ops);
+        reps++;
+    } while ((elapsed = now() - start) < MIN_TIME);
+    return elapsed / reps;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mdriver [-achpsv] [-t <tracedir>] [-f <tracefile>]...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-a         Run the traces under every placement policy (MM_POLICY).\n");
+    fprintf(stderr, "\t-c         Run mm_check after every request.\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as a trace file (may be repeated).\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-p         Print the heap profile at peak live payload.\n");
+    fprintf(stderr, "\t-s         Print the allocator statistics of each trace.\n");
+    fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-v         Print progress for each trace.\n");
+}
+
+/*
+ * show_stats - print the allocator counters of the trace just run
+ */
+static void show_stats(char *tracename)
+{
+    struct mm_stats st;
+
+    mm_stats(&st);
+    printf("\n%s: %lu mallocs (%lu from tcache), %lu frees, %lu reallocs, %zu bytes live\n",
+           tracename, st.mallocs, st.tcache_hits, st.frees, st.reallocs, st.live_bytes);
+    printf("  heap %zu bytes (peak %zu), %zu mapped, %lu sbrk calls\n",
+           st.heap_bytes, st.peak_heap_bytes, st.mmap_bytes, st.sbrk_calls);
+    printf("  %lu fit searches, %.2f probes/search, coalesced %lu prev %lu next %lu both\n",
+           st.fit_searches, st.avg_probes, st.coalesce_prev, st.coalesce_next, st.coalesce_both);
+    printf("  mallocs by size:");
+    for (int k = 0; k < MM_STATS_CLASSES; k++)
+        if (st.class_mallocs[k]) printf(" %lu:%lu", 16UL << k, st.class_mallocs[k]);
+    printf("\n");
+}
+
+/*
+ * run_traces - evaluate and print results for each trace, returns 1 if all were valid
+ * and sets the average utilization and overall Kops/sec
+ */
+static int run_traces(char *tracedir, char **tracefiles, int num_tracefiles, double *avg_util, double *kops)
+{
+    stats_t stats[MAX_TRACES];
+    double total_util = 0, total_ops = 0, total_secs = 0;
+    int all_valid = 1, peak_op = 0;
+
+    for (int i = 0; i < num_tracefiles; i++) {
+        if (verbose) printf("Checking mm_malloc on %s%s\n", tracedir, tracefiles[i]);
+        trace_t *trace = read_trace(tracedir, tracefiles[i]);
+
+        stats[i].ops = trace->num_ops;
+        stats[i].valid = eval_mm_valid(trace, tracefiles[i], &stats[i].util, &peak_op);
+        if (stats[i].valid && print_stats) show_stats(tracefiles[i]);
+        stats[i].secs = stats[i].valid ? eval_mm_speed(trace) : 0;
+        if (stats[i].valid && profile) {
+            replay(trace, peak_op + 1);
+            printf("\n%s at request %d (peak live payload):\n", tracefiles[i], peak_op);
+            mm_profile(stdout);
+            free_blocks(trace);
+        }
+        if (!stats[i].valid) all_valid = 0;
+        free_trace(trace);
+    }
+
+    printf("\n%-18s %5s %6s %8s %10s %12s\n", "trace", "valid", "util", "ops", "secs", "Kops/sec");
+    for (int i = 0; i < num_tracefiles; i++) {
+        if (stats[i].valid) {
+            printf("%-18s %5s %5.1f%% %8.0f %10.6f %12.0f\n", tracefiles[i], "yes",
+                   stats[i].util * 100.0, stats[i].ops, stats[i].secs, stats[i].ops / stats[i].secs / 1e3);
+            total_util += stats[i].util;
+            total_ops += stats[i].ops;
+            total_secs += stats[i].secs;
+        } else {
+            printf("%-18s %5s %6s %8s %10s %12s\n", tracefiles[i], "no", "-", "-", "-", "-");
+        }
+    }
+    *avg_util = total_util / num_tracefiles;
+    *kops = total_secs > 0 ? total_ops / total_secs / 1e3 : 0;
+    if (all_valid)
+        printf("%-18s %5s %5.1f%% %8.0f %10.6f %12.0f\n", "Total", "", *avg_util * 100.0,
+               total_ops, total_secs, *kops);
+    return all_valid;
+}
+
+int main(int argc, char **argv)
+{
+    char *tracefiles[MAX_TRACES];
+    char tracedir[MAXLINE] = TRACEDIR;
+    int num_tracefiles = 0, all_valid = 1, all_policies = 0, c;
+    double util[sizeof(policies) / sizeof(policies[0])], kops[sizeof(policies) / sizeof(policies[0])];
+
+    while ((c = getopt(argc, argv, "f:t:achpsv")) != EOF) {
+        switch (c) {
+        case 'f':
+            if (num_tracefiles == MAX_TRACES) app_error("Too many trace files");
+            tracefiles[num_tracefiles++] = optarg;
+            strcpy(tracedir, "");
+            break;
+        case 't':
+            snprintf(tracedir, MAXLINE, "%s/", optarg);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'a':
+            all_policies = 1;
+            break;
+        case 'c':
+            check = 1;
+            break;
+        case 'p':
+            profile = 1;
+            break;
+        case 's':
+            print_stats = 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (num_tracefiles == 0)
+        for (num_tracefiles = 0; default_tracefiles[num_tracefiles]; num_tracefiles++)
+            tracefiles[num_tracefiles] = default_tracefiles[num_tracefiles];
+
+    printf("Team: %s (%s)\n", team.name, team.id);
+    mem_init();
+    if (!eval_mm_limits()) all_valid = 0;
+    if (!eval_mm_zeroed()) all_valid = 0;
+    if (!eval_mm_aligned()) all_valid = 0;
+
+    if (!all_policies) {
+        if (!run_traces(tracedir, tracefiles, num_tracefiles, &util[0], &kops[0])) all_valid = 0;
+    } else {
+        for (int p = 0; policies[p]; p++) {
+            setenv("MM_POLICY", policies[p], 1);
+            printf("\nMM_POLICY=%s", policies[p]);
+            if (!run_traces(tracedir, tracefiles, num_tracefiles, &util[p], &kops[p])) all_valid = 0;
+        }
+        printf("\n%-18s %6s %12s\n", "policy", "util", "Kops/sec");
+        for (int p = 0; policies[p]; p++)
+            printf("%-18s %5.1f%% %12.0f\n", policies[p], util[p] * 100.0, kops[p]);
+    }
+
+    mem_deinit();
+    return all_valid ? 0 : 1;
+}
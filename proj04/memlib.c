@@ -0,0 +1,251 @@
+/*
+ * memlib.c - a module that simulates the memory system
+ *
+ * The heap is one fixed MAX_HEAP region reserved with mmap, and mem_sbrk
+ * moves a break pointer inside it. The region is reserved lazily by the
+ * kernel (MAP_NORESERVE), so only pages the allocator touches cost memory,
+ * and whole pages given back by a negative mem_sbrk are released again.
+ * They are released with MADV_FREE where there is one: the kernel only takes
+ * them when it needs the memory, so a heap that grows back right after being
+ * trimmed doesn't fault every page in again.
+ *
+ * mem_mmap/mem_munmap hand out separate mappings for blocks that don't
+ * live in the heap. They are tracked so that the driver can account
+ * for them in utilization and check payloads against them.
+ * Built with -DMEM_NOTRACK (the malloc shim) they are only counted, since
+ * the tracking list itself would need malloc.
+ */
+#define _GNU_SOURCE     /* mremap */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "memlib.h"
+
+/* a live mapping from mem_mmap */
+struct mem_map {
+    char *addr;
+    size_t len;
+    struct mem_map *next;
+};
+
+/* private variables */
+static char *mem_start_brk;  /* points to first byte of heap */
+static char *mem_brk;        /* points to last byte of heap plus 1 */
+static char *mem_max_addr;   /* largest legal heap address plus 1 */
+static char *mem_zero_brk;   /* the region is still zero-filled from here on */
+static struct mem_map *mem_maps = NULL;    /* live mappings */
+static size_t mem_mapped = 0;              /* total bytes in live mappings */
+static pthread_mutex_t mem_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* 
+ * mem_init - reserve the region for the heap
+ */
+void mem_init(void)
+{
+    mem_start_brk = mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+        fprintf(stderr, "mem_init: mmap failed\n");
+        exit(1);
+    }
+    mem_max_addr = mem_start_brk + MAX_HEAP;
+    mem_brk = mem_zero_brk = mem_start_brk;
+}
+
+/* 
+ * mem_deinit - release the heap region
+ */
+void mem_deinit(void)
+{
+    munmap(mem_start_brk, MAX_HEAP);
+}
+
+/*
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ */
+void mem_reset_brk(void)
+{
+    mem_brk = mem_start_brk;
+}
+
+/* 
+ * mem_sbrk - simple model of the sbrk function. Extends the heap 
+ *    by incr bytes (or shrinks it if incr is negative) and returns
+ *    the start address of the new area (the old break).
+ */
+void *mem_sbrk(int incr) 
+{
+    char *old_brk = mem_brk;
+
+    if ((incr > 0 && incr > mem_max_addr - mem_brk) ||
+        (incr < 0 && -incr > mem_brk - mem_start_brk)) {
+        errno = ENOMEM;
+        fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+        return (void *)-1;
+    }
+    mem_brk += incr;
+    if (incr < 0) {     /* hand whole pages above the new break back to the kernel */
+        uintptr_t page = mem_pagesize();
+        char *lo = (char *)(((uintptr_t)mem_brk + page - 1) & ~(page - 1));
+#ifdef MADV_FREE
+        if (lo < old_brk)   /* may still hold their old contents, mem_zero_brk stays */
+            madvise(lo, old_brk - lo, MADV_FREE);
+#else
+        if (lo < old_brk && madvise(lo, old_brk - lo, MADV_DONTNEED) == 0 && lo < mem_zero_brk)
+            mem_zero_brk = lo;  /* they read as zero again */
+#endif
+    } else if (mem_brk > mem_zero_brk) {
+        mem_zero_brk = mem_brk;
+    }
+    return (void *)old_brk;
+}
+
+/*
+ * mem_heap_lo - return address of the first heap byte
+ */
+void *mem_heap_lo(void)
+{
+    return (void *)mem_start_brk;
+}
+
+/* 
+ * mem_heap_hi - return address of last heap byte
+ */
+void *mem_heap_hi(void)
+{
+    return (void *)(mem_brk - 1);
+}
+
+/*
+ * mem_heap_zero - return the address from which the heap region has never been
+ *    handed out (or was given back with MADV_DONTNEED), so reads as zero
+ */
+void *mem_heap_zero(void)
+{
+    return (void *)mem_zero_brk;
+}
+
+/*
+ * mem_heapsize() - returns the heap size in bytes
+ */
+size_t mem_heapsize(void) 
+{
+    return (size_t)(mem_brk - mem_start_brk);
+}
+
+/*
+ * mem_pagesize() - returns the page size of the system
+ */
+size_t mem_pagesize(void)
+{
+    return (size_t)getpagesize();
+}
+
+/*
+ * mem_mmap - map len bytes (a multiple of the page size) outside the heap
+ */
+void *mem_mmap(size_t len)
+{
+    char *addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (addr == MAP_FAILED)
+        return NULL;
+#ifdef MEM_NOTRACK
+    __atomic_fetch_add(&mem_mapped, len, __ATOMIC_RELAXED);
+#else
+    struct mem_map *m;
+
+    if ((m = malloc(sizeof(struct mem_map))) == NULL) {
+        munmap(addr, len);
+        return NULL;
+    }
+    m->addr = addr;
+    m->len = len;
+    pthread_mutex_lock(&mem_map_lock);
+    m->next = mem_maps;
+    mem_maps = m;
+    mem_mapped += len;
+    pthread_mutex_unlock(&mem_map_lock);
+#endif
+    return addr;
+}
+
+/*
+ * mem_munmap - release a mapping returned by mem_mmap
+ */
+void mem_munmap(void *addr, size_t len)
+{
+#ifdef MEM_NOTRACK
+    __atomic_fetch_sub(&mem_mapped, len, __ATOMIC_RELAXED);
+#else
+    struct mem_map **pp, *m;
+
+    pthread_mutex_lock(&mem_map_lock);
+    for (pp = &mem_maps; (m = *pp) != NULL; pp = &m->next) {
+        if (m->addr == addr) {
+            *pp = m->next;
+            mem_mapped -= m->len;
+            free(m);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mem_map_lock);
+#endif
+    munmap(addr, len);
+}
+
+/*
+ * mem_mremap - resize a mapping returned by mem_mmap, moving it if needed
+ */
+void *mem_mremap(void *addr, size_t old_len, size_t new_len)
+{
+    char *new_addr = mremap(addr, old_len, new_len, MREMAP_MAYMOVE);
+
+    if (new_addr == MAP_FAILED)
+        return NULL;
+#ifdef MEM_NOTRACK
+    __atomic_fetch_add(&mem_mapped, new_len - old_len, __ATOMIC_RELAXED);
+#else
+    struct mem_map *m;
+
+    pthread_mutex_lock(&mem_map_lock);
+    for (m = mem_maps; m; m = m->next) {
+        if (m->addr == addr) {
+            m->addr = new_addr;
+            m->len = new_len;
+            mem_mapped += new_len - old_len;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mem_map_lock);
+#endif
+    return new_addr;
+}
+
+/*
+ * mem_mapsize - returns the total size of live mappings in bytes
+ */
+size_t mem_mapsize(void)
+{
+    return mem_mapped;
+}
+
+/*
+ * mem_in_map - returns 1 if [addr, addr+len) lies inside one live mapping
+ *    (always 0 when mappings aren't tracked)
+ */
+int mem_in_map(void *addr, size_t len)
+{
+    struct mem_map *m;
+    int found = 0;
+
+    pthread_mutex_lock(&mem_map_lock);
+    for (m = mem_maps; m && !found; m = m->next)
+        found = (char *)addr >= m->addr && (char *)addr + len <= m->addr + m->len;
+    pthread_mutex_unlock(&mem_map_lock);
+    return found;
+}
@@ -0,0 +1,30 @@
+/*
+ * memlib.h - model of the memory system used by mm.c
+ */
+#ifndef __MEMLIB_H__
+#define __MEMLIB_H__
+
+#include <unistd.h>
+
+#ifndef MAX_HEAP
+#define MAX_HEAP (100*(1<<20))  /* 100 MB */
+#endif
+
+void mem_init(void);
+void mem_deinit(void);
+void *mem_sbrk(int incr);
+void mem_reset_brk(void);
+void *mem_heap_lo(void);
+void *mem_heap_hi(void);
+void *mem_heap_zero(void);
+size_t mem_heapsize(void);
+size_t mem_pagesize(void);
+
+/* separate mappings outside the sbrk heap (large blocks) */
+void *mem_mmap(size_t len);
+void mem_munmap(void *addr, size_t len);
+void *mem_mremap(void *addr, size_t old_len, size_t new_len);
+size_t mem_mapsize(void);
+int mem_in_map(void *addr, size_t len);
+
+#endif /* __MEMLIB_H__ */
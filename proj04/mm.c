@@ -1,8 +1,9 @@
 /*
- * Simple, 32-bit and 64-bit clean allocator based on implicit free
- * lists, first-fit placement, and boundary tag coalescing
+ * Simple, 32-bit and 64-bit clean allocator based on segregated explicit
+ * free lists for small blocks, a red-black tree for large ones, and boundary tag coalescing
  * Blocks must be aligned to doubleword (8 byte).
  * boundaries. Minimum block size is 16 bytes.
+ * Allocated blocks have no footer.
  */
  
  /*
@@ -10,17 +11,113 @@ Memory layout of a block in explicit list
 
 // Free block
 [ Header (4bytes) | {Payload(empty): Next Ptr (4bytes) | Prev Ptr (4bytes) } (Nbytes) | Footer (4bytes) ]
+(the "pointers" are 32-bit offsets from heap_base, 0 meaning NULL, on 32-bit and 64-bit
+alike, so the minimum block stays 16 bytes; the heap region is far below 4GB.
+Following one costs an add and a test for 0 more than a raw pointer, which the traces
+don't measure above noise)
 
 // Allocated block
-[ Header (4bytes) | Payload (Nbytes) | Footer (4bytes) ]
-
-Header contains size of current block, and allocation status in the LSB (0 if free, 1 if alloc)
-Footer has same content as header, used in coalescing with physically nearby free blocks
+[ Header (4bytes) | Payload (Nbytes) ]
+
+Header contains size of current block, allocation status in the LSB (0 if free, 1 if alloc),
+allocation status of the physically previous block in bit 1 (PREV_ALLOC),
+and for allocated blocks whether mm_realloc has grown it before in bit 2 (REALLOCED)
+Footer has same content as header, used in coalescing with physically nearby free blocks.
+Only free blocks need one, since coalesce() only looks at the previous block's footer
+after PREV_ALLOC in the current header says it is free
 Next, Prev Ptrs are self-explanatory, used to structure heap as a doubly linked list
 Payload is where actual stuff goes in
 
+Free blocks below TREE_MIN are kept in NUM_CLASSES segregated lists, one per power-of-two
+size class: class k holds blocks of size [2^(k+4), 2^(k+5)). Lists are LIFO so insert/delete
+are O(1). seg_bitmap has bit k set iff list k is non-empty, so the smallest non-empty class
+above k is found with a single ctz.
+
+Free blocks of TREE_MIN bytes and more are kept in a red-black tree ordered by (size, address),
+whose left/right/parent links and color live in the free block like the list links do.
+Best fit is a lower bound search, and a large fragmented heap costs O(log n) per
+insert/delete/search instead of long list walks. (A splay tree was tried first: splaying
+on every insert/delete from coalesce cost about twice as much on the traces.) TREE_MIN is
+4KB: with the tree starting at 1KB, random.rep spent most of its time rebalancing on
+coalesce/split churn of mid-sized blocks that a LIFO list handles in O(1).
+
+Placement policy, chosen by the MM_POLICY environment variable at mm_init:
+  seg   (default) first fit in the request's class, else the head of the next non-empty class
+  first lowest-addressed block that fits, as first fit on an address-ordered list would find
+  next  first fit in list order from the request's class up, each search resuming
+        where the previous one stopped (rover)
+  best  smallest block that fits
+Blocks in the tree are always taken best fit, except by first.
+
+Deferred coalescing, enabled by setting MM_DEFER (to anything but 0) at mm_init: heap_free
+puts blocks below TREE_MIN into exact-size quick bins instead of coalescing them, marked
+allocated so their neighbours don't merge with them either, and heap_malloc takes an exact
+fit from there first. The whole quick bin contents are coalesced into the free lists in one
+pass when QUICK_LIMIT blocks have piled up, or when a malloc finds no fit before extending
+the heap. Churny workloads that free and reallocate the same sizes then skip the
+delete/insert round trips of coalescing and splitting altogether.
+
 So for a free block, the unused payload is utilized to keep the ptr to next and prev free blocks
 For allocated block, we don't care and assume the user holds the address and frees them later
+
+Thread safety: the heap itself (free lists, heap_malloc/heap_free/heap_realloc) is guarded
+by heap_lock. In front of it each thread keeps a tcache: TCACHE_BINS exact-size bins of
+up to TCACHE_COUNT freed small blocks, linked through their first payload word.
+Blocks in a tcache stay marked allocated in the heap, so a malloc that hits the
+tcache and a free that fits into it never take the lock.
+
+Large blocks: requests of at least mmap_threshold bytes get their own mapping from
+mem_mmap instead of a heap block, and are unmapped again on free, so they neither
+fragment the heap nor stay with the process. They are recognized by lying outside
+the heap region (IN_HEAP), and keep the mapping length MMAP_HDR bytes before the payload
+(and, for aligned blocks, the padding in front of that header next to it).
+As in glibc the threshold adapts: freeing a mapped block larger than the threshold
+(up to MMAP_THRESHOLD_MAX) raises it to that size, since the program evidently
+allocates such blocks repeatedly. The heap is trimmed whenever the free block at its
+end reaches trim_threshold (twice the mmap threshold), keeping TRIM_PAD bytes of it.
+
+Small blocks: requests of up to SLAB_MAX bytes are served from slabs instead, one
+SLAB_SIZE-aligned heap block per slab carved into equal slots of one size (multiples
+of 8 bytes), so they carry no header at all. A slab starts with a struct slab whose
+bitmap has a bit set per free slot; malloc takes the first set bit with ctz and free
+sets it again, both O(1). Slabs with free slots are on a per-size list, and a slab
+whose slots are all free goes back to the heap unless it is the only one of its size.
+slab_pages has a bit per SLAB_SIZE page of the heap region set iff a slab starts there,
+which is how mm_free tells a slot from a heap block (no heap payload starts inside
+the first SLAB_SIZE - WSIZE bytes of another block). Slots go through the tcache
+as well, binned by slot size; heap blocks that small never enter it.
+
+Aligned blocks: mm_memalign takes an ordinary slot for small requests up to
+SLAB_ALIGN_MAX (a cache line): the first slot of a slab is 16-byte aligned, or
+SLAB_ALIGN_MAX-aligned if the slot size is a multiple of that, so a slot size that is a
+multiple of the alignment (16, or 64 for 32 and 64) keeps every slot aligned. Larger
+alignments are carved out of a free heap block, giving the gap in front back as a free
+block, and mapped blocks leave the gap unused in front of their header.
+mm_calloc only clears what may be dirty: mappings are zero-filled by the kernel, and
+of a heap block only the part below mem_heap_zero() and the free block links and
+footer the allocator itself wrote there.
+
+Debugging: mm_check walks the heap, the free lists and the slabs and reports every
+inconsistency (compile with -DMM_CHECK to run it after each call and abort on the
+first error). mm_profile prints the free block histogram and fragmentation; it only
+walks the free lists, and the search counters it reports are kept all the time,
+so it is cheap enough to sample in a production build.
+
+Hardened mode (compile with -DMM_DEBUG, nothing of it is built otherwise): the mm_*
+entry points become wrappers around the real ones, which are renamed *_raw. Every
+block gets a struct dbg_hdr in front of the payload, recording its requested size,
+state and allocation site (the caller's return address), ending in a canary word, and
+a canary word right behind the payload. mm_free checks both canaries and the state,
+reporting overflows, underflows, double frees (with where the block was allocated and
+first freed) and frees of pointers it never handed out, and aborts. Freed blocks are
+filled with DBG_FREED_BYTE and held in a FIFO quarantine of up to DBG_QUARANTINE blocks
+(DBG_QUARANTINE_BYTES) before they are really freed, so use-after-free writes are found when they leave it
+(or by mm_check) and double frees are caught while they are there. make check-debug
+runs mdebug, which checks that each kind of misuse aborts with its report.
+
+Statistics: mm_stats fills a struct mm_stats with counters kept as the allocator runs.
+Counters updated on the lock-free paths (mallocs, frees, live bytes, ...) are relaxed
+atomics; the rest (sbrk calls, coalescing, heap size) only change under heap_lock.
 */
 
 
@@ -28,6 +125,7 @@ For allocated block, we don't care and assume the user holds the address and fre
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -66,26 +164,182 @@ team_t team = {
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)                 
+#define PREV_ALLOC   0x2
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#define REALLOCED    0x4    /* allocated block has been grown by mm_realloc before (kept through a tcache round trip) */
+#define GET_REALLOCED(p)  (GET(p) & REALLOCED)
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)                      
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE) 
 
-/* Given block ptr bp, compute address of physical next and prev blocks */
+/* Given block ptr bp, compute address of physical next and prev blocks (prev only if it is free) */
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE))) 
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
 /* rounds up to the nearest multiple of ALIGNMENT */
 #define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
 
-#define NEXT_FREEP(ptr) (*(char **)(ptr))
-#define PREV_FREEP(ptr) (*(char **)(ptr + WSIZE))
+/* Free block links: 32-bit offsets from heap_base, 0 is NULL (offset 0 is the alignment padding) */
+#define TO_OFF(ptr)  ((ptr) ? (unsigned int)((char *)(ptr) - heap_base) : 0)
+#define FROM_OFF(off) from_off(off)
+#define NEXT_FREEP(ptr) FROM_OFF(GET(ptr))
+#define PREV_FREEP(ptr) FROM_OFF(GET((char *)(ptr) + WSIZE))
+#define SET_NEXT_FREEP(ptr, val) PUT(ptr, TO_OFF(val))
+#define SET_PREV_FREEP(ptr, val) PUT((char *)(ptr) + WSIZE, TO_OFF(val))
+#if MAX_HEAP > 0xffffffff
+#error "free block offsets are 32 bits, MAX_HEAP must stay below 4GB"
+#endif
 #define BLOCK_SIZE(ptr) (GET_SIZE(HDRP(ptr)))
-#define SET(p, ptr) (*(uintptr_t *)(p) = (uintptr_t)(ptr))
+#define TC_NEXT(ptr) (*(char **)(ptr))     /* tcache link, a raw pointer (also used for slab slots) */
+
+/* Minimum block: header + next/prev ptrs + footer */
+#define MIN_BLOCK   ALIGN(DSIZE + (WSIZE << 1))
+
+/* Segregated free lists */
+#define NUM_CLASSES 8       /* class k: [2^(k+4), 2^(k+5)), up to TREE_MIN */
+#define HIST_BINS   MM_STATS_CLASSES    /* histogram bins, same power-of-two ranges up to 2^32 */
+#define HIST_BIN(size) MIN(MAX(31 - __builtin_clz((unsigned int)(size)) - 4, 0), HIST_BINS - 1)
+
+/* Red-black tree of large free blocks */
+#define TREE_MIN    (1 << (NUM_CLASSES + 4))
+#define LEFT(bp)    FROM_OFF(GET(bp))
+#define RIGHT(bp)   FROM_OFF(GET((char *)(bp) + WSIZE))
+#define PARENT(bp)  FROM_OFF(GET((char *)(bp) + DSIZE))
+#define SET_LEFT(bp, val)   PUT(bp, TO_OFF(val))
+#define SET_RIGHT(bp, val)  PUT((char *)(bp) + WSIZE, TO_OFF(val))
+#define SET_PARENT(bp, val) PUT((char *)(bp) + DSIZE, TO_OFF(val))
+#define COLOR(bp)   (*((char *)(bp) + 3 * WSIZE))
+#define RED         1
+#define BLACK       0
+#define IS_RED(bp)  ((bp) != NULL && COLOR(bp) == RED)
+
+/* Quick bins of freed blocks waiting to be coalesced (MM_DEFER) */
+#define QUICK_BINS   (TREE_MIN >> 3)        /* one bin per block size 8, 16, ..., below TREE_MIN */
+#define QUICK_BIN(size) (((size) >> 3) - 1)
+#define QUICK_LIMIT  64                     /* blocks binned before they are all coalesced */
+
+/* Per-thread cache of small blocks */
+#define TCACHE_BINS  64                     /* one bin per size 8, 16, ... (slot size, or block size above SLAB_MAX) */
+#define TCACHE_COUNT 7                      /* max blocks kept per bin */
+#define TCACHE_MAX   (TCACHE_BINS << 3)     /* largest cached size */
+#define TCACHE_BIN(size) (((size) >> 3) - 1)
+
+/* Slabs of equal-size slots for small requests */
+#define SLAB_SIZE    (1<<10)                /* bytes per slab, also its alignment (small, since traces keep few slots live) */
+#define SLAB_MAX     256                    /* largest request served from a slab */
+#define SLAB_CLASSES (SLAB_MAX >> 3)        /* one per slot size 8, 16, ..., SLAB_MAX */
+#define SLAB_WORDS   (SLAB_SIZE >> 9)       /* bitmap words per slab, enough for SLAB_SIZE / 8 slots */
+#define SLAB_HDR     ALIGN(sizeof(struct slab))
+#define SLAB_ALIGN_MAX 64                   /* slots of a multiple of this size are aligned to it (cache line) */
+#define SLAB_SLOT_ALIGN(size) ((size) % SLAB_ALIGN_MAX ? DSIZE << 1 : SLAB_ALIGN_MAX)   /* first slot's alignment */
+#define SLAB_FIRST(size) ((SLAB_HDR + SLAB_SLOT_ALIGN(size) - 1) & ~(SLAB_SLOT_ALIGN(size) - 1))
+#define SLAB_CLASS(size) (((size) >> 3) - 1)
+#define SLAB_PAGE(bp) (((char *)(bp) - (char *)mem_heap_lo()) / SLAB_SIZE)
+
+/* Statistics, atomic for counters also updated outside heap_lock */
+#define STAT_ADD(field, n) __atomic_fetch_add(&stats.field, (n), __ATOMIC_RELAXED)
+#define STAT_SUB(field, n) __atomic_fetch_sub(&stats.field, (n), __ATOMIC_RELAXED)
+/* and per thread for those counted on every call, so the lock-free paths stay free of
+   shared writes: only the owner writes them, mm_stats reads them (no RMW needed) */
+#define TSTAT_ADD(tc, field, n) \
+    __atomic_store_n(&(tc)->stats.field, (tc)->stats.field + (n), __ATOMIC_RELAXED)
+#define STAT_MALLOC(tc, asize, bytes) do {              \
+    TSTAT_ADD(tc, mallocs, 1);                          \
+    TSTAT_ADD(tc, class_mallocs[HIST_BIN(asize)], 1);   \
+    TSTAT_ADD(tc, live_bytes, bytes);                   \
+} while (0)
+#define STAT_FREE(tc, bytes) do {                       \
+    TSTAT_ADD(tc, frees, 1);                            \
+    TSTAT_ADD(tc, live_bytes, -(size_t)(bytes));        \
+} while (0)
+
+/* Debug mode: check the whole heap after every call (heap_lock held) */
+#ifdef MM_CHECK
+#define CHECK_HEAP() do { if (heap_check(0)) abort(); } while (0)
+#else
+#define CHECK_HEAP()
+#endif
+
+/* Hardened mode: the real entry points, wrapped at the end of the file */
+#ifdef MM_DEBUG
+#define mm_malloc       mm_malloc_raw
+#define mm_free         mm_free_raw
+#define mm_realloc      mm_realloc_raw
+#define mm_memalign     mm_memalign_raw
+#define mm_calloc       mm_calloc_raw
+#define mm_usable_size  mm_usable_size_raw
+static void *mm_malloc(size_t size);
+static void mm_free(void *ptr);
+static void *mm_realloc(void *ptr, size_t size) __attribute__((unused));    // the wrapper always moves
+static void *mm_memalign(size_t alignment, size_t size);
+static void *mm_calloc(size_t nmemb, size_t size);
+static size_t mm_usable_size(void *ptr) __attribute__((unused));
+static int dbg_check(void);
+static void dbg_reset(void);
+#endif
+
+/* Large blocks served by separate mappings */
+#define MMAP_THRESHOLD_MIN (128 * 1024)         /* initial mmap threshold */
+#define MMAP_THRESHOLD_MAX (32 * 1024 * 1024)   /* the threshold never grows past this */
+#define TRIM_PAD    (128 * 1024)                /* free bytes kept at the heap end when trimming */
+#define MMAP_HDR    (DSIZE << 1)                /* mapping length (size_t) + lead + header word, keeps payload aligned */
+#define MMAP_LEN(bp) (*(size_t *)((char *)(bp) - MMAP_HDR))
+#define MMAP_LEAD(bp) GET((char *)(bp) - DSIZE)  /* unused bytes before the header (aligned blocks) */
+#define MMAP_BASE(bp) ((char *)(bp) - MMAP_HDR - MMAP_LEAD(bp))
+#define IN_HEAP(bp) ((char *)(bp) >= (char *)mem_heap_lo() && (char *)(bp) < (char *)mem_heap_lo() + MAX_HEAP)
 /* $end mallocmacros */
 
 /* Global variables */
-static void *heap_listp = NULL; // Empty list
+static char *seg_lists[NUM_CLASSES];    // head of each size class list
+static unsigned int seg_bitmap = 0;     // bit k set iff seg_lists[k] is non-empty
+static char *heap_base;                 // mem_heap_lo(), base of free block link offsets
+static char *tree_root = NULL;          // red-black tree of free blocks >= TREE_MIN
+
+/* a function rather than a macro so that tests like "if (LEFT(bp))" don't warn */
+static inline char *from_off(unsigned int off) {
+    return off ? heap_base + off : NULL;
+}
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER; // guards everything above
+static unsigned int heap_gen = 0;       // bumped by mm_init, invalidates all tcaches
+static size_t mmap_threshold = MMAP_THRESHOLD_MIN;      // requests this large get their own mapping
+static size_t trim_threshold = MMAP_THRESHOLD_MIN << 1; // free heap tail this large is given back
+
+struct slab {
+    struct slab *next, *prev;           // list of slabs of this size with free slots
+    unsigned short size;                // slot size
+    unsigned short nslots;
+    unsigned short nfree;
+    unsigned short hint;                // no free slot in map[0 .. hint-1]
+    uint64_t map[SLAB_WORDS];           // bit set iff slot is free
+};
+static struct slab *slab_lists[SLAB_CLASSES];
+static uint64_t slab_pages[MAX_HEAP / SLAB_SIZE / 64 + 1];     // bit set iff a slab starts at that page
+static unsigned long fit_searches = 0;  // fit_block calls
+static unsigned long fit_steps = 0;     // free blocks fit_block looked at
+static struct mm_stats stats;           // see mm_stats (fit counters above are folded in there)
+
+enum fit_policy { FIT_SEG, FIT_FIRST, FIT_NEXT, FIT_BEST };
+static const char *fit_policy_names[] = { "seg", "first", "next", "best" };
+static enum fit_policy fit_policy = FIT_SEG;
+static char *rover = NULL;              // next fit: free block the next search starts at
+
+static int defer_coalesce = 0;          // MM_DEFER: free into quick bins
+static char *quick_bins[QUICK_BINS];    // blocks freed but not coalesced yet, linked like the lists
+static unsigned int quick_count = 0;    // blocks in all quick bins
+
+struct tcache {
+    char *bins[TCACHE_BINS];            // singly linked through first payload word
+    unsigned char counts[TCACHE_BINS];
+    unsigned int gen;                   // heap_gen this cache was filled under
+    int registered;                     // exit destructor registered for this thread
+    struct mm_stats stats;              // this thread's per-call counters (TSTAT_ADD), under gen
+    struct tcache *next;                // in tcache_list while registered
+};
+static __thread struct tcache tcache;
+static struct tcache *tcache_list = NULL;   // caches of live threads, for mm_stats (heap_lock)
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
 
 
 /* Function prototypes for internal helper routines */
@@ -95,10 +349,34 @@ static void create_heap(char *heap_s);
 
 static void *extend_heap(size_t words);
 
-static char *extend_heap_if_needed(char *bp, size_t asize, int *left);
+static char *extend_heap_if_needed(char *bp, size_t asize);
 
 static char *fit_block(size_t asize);
 
+static char *first_fit(size_t asize, int class);
+
+static int tree_before(char *a, char *b);
+
+static void tree_rotate(char *x);
+
+static void tree_insert(char *bp);
+
+static void tree_transplant(char *u, char *v);
+
+static void tree_delete(char *bp);
+
+static void tree_delete_fixup(char *x, char *xp);
+
+static char *tree_lower_bound(size_t asize);
+
+static char *tree_next(char *bp);
+
+static char *tree_first_fit(size_t asize);
+
+static char *scan_fit(size_t asize, int class, char *start);
+
+static char *best_fit(size_t asize, int class);
+
 static void *place(void *bp, size_t asize); // Modified return type
 
 static void *coalesce(void *bp);
@@ -107,31 +385,92 @@ static void insert(size_t size, char *ptr);
 
 static void delete(char *ptr);
 
+static int size_class(size_t size);
+
+static void *heap_malloc(size_t asize);
+
+static void heap_free(void *bp);
+
+static void quick_consolidate(void);
+
+static void *heap_realloc(void *ptr, size_t size);
+
+static void resize_block(char *bp, size_t csize, size_t asize);
 
-/* packing, putting header */
-#define SET_HDR(bp, size, alloc) PUT(HDRP(bp), PACK(size, alloc))
+static struct tcache *tcache_get(void);
 
-/* packing, putting footer */
+static void tcache_flush(void *arg);
+
+static void tcache_key_create(void);
+
+static void *mmap_alloc(size_t size, size_t align);
+
+static void mmap_free(void *bp);
+
+static void *mmap_realloc(void *bp, size_t size);
+
+static void trim_heap(char *bp);
+
+static char *align_in_block(char *bp, size_t align);
+
+static void *heap_malloc_aligned(size_t asize, size_t align);
+
+static struct slab *slab_of(void *bp);
+
+static void *slab_malloc(size_t ssize);
+
+static void slab_free(struct slab *slab, void *bp);
+
+static int heap_check(int verbose);
+
+static size_t block_bytes(void *bp);
+
+static void stats_add(struct mm_stats *dst, struct mm_stats *src);
+
+
+/* packing, putting header (keeps the PREV_ALLOC bit already in the header) */
+#define SET_HDR(bp, size, alloc) PUT(HDRP(bp), PACK(size, alloc) | GET_PREV_ALLOC(HDRP(bp)))
+
+/* packing, putting header of a new block whose old header word is garbage */
+#define NEW_HDR(bp, size, prev_alloc, alloc) PUT(HDRP(bp), PACK(size, alloc) | ((prev_alloc) ? PREV_ALLOC : 0))
+
+/* packing, putting footer (free blocks only) */
 #define SET_FTR(bp, size, alloc) PUT(FTRP(bp), PACK(size, alloc))
 
+/* update PREV_ALLOC bit of the block physically after bp
+ * (atomic: that block may be allocated and its owner reading its size in mm_free without the lock) */
+#define MARK_NEXT_ALLOC(bp) __atomic_fetch_or((unsigned int *)HDRP(NEXT_BLKP(bp)), PREV_ALLOC, __ATOMIC_RELAXED)
+#define MARK_NEXT_FREE(bp)  __atomic_fetch_and((unsigned int *)HDRP(NEXT_BLKP(bp)), ~PREV_ALLOC, __ATOMIC_RELAXED)
+
 /* splitting block, handle free list */
 #define SPLIT_BLK(bp, size, free) do {      \
     SET_HDR(bp, size, 1);              		\
-	SET_FTR(bp, size, 1);					\
-    SET_HDR(NEXT_BLKP(bp), free, 0);        \
+    NEW_HDR(NEXT_BLKP(bp), free, 1, 0);     \
 	SET_FTR(NEXT_BLKP(bp), free, 0);        \
     insert(free, NEXT_BLKP(bp));            \
 } while(0)
 
-#define NEXT_NOT_ALLOC(ptr) (!GET_ALLOC(HDRP(NEXT_BLKP(ptr))) || !BLOCK_SIZE(NEXT_BLKP(ptr)))
+/* realloc history bit of allocated blocks (cleared whenever the header is rewritten by SET_HDR) */
+#define SET_REALLOCED(bp) PUT(HDRP(bp), GET(HDRP(bp)) | REALLOCED)
 
 /*
  * Initializes list pointer, heap space
  */
 static char *init_heap_space(void) {
-    heap_listp = NULL;
+    memset(seg_lists, 0, sizeof(seg_lists));
+    seg_bitmap = 0;
+    heap_base = mem_heap_lo();
+    tree_root = NULL;
+    memset(slab_lists, 0, sizeof(slab_lists));
+    memset(slab_pages, 0, sizeof(slab_pages));
+    fit_searches = fit_steps = 0;
+    memset(&stats, 0, sizeof(stats));
+    rover = NULL;
+    memset(quick_bins, 0, sizeof(quick_bins));
+    quick_count = 0;
     char *heap_s = mem_sbrk(WSIZE << 2);
     if(heap_s == (void *) -1) return (void *) -1;
+    stats.sbrk_calls++;
     return heap_s;
 }
 
@@ -142,7 +481,7 @@ static void create_heap(char *heap_s) {
     PUT(heap_s, 0);                             // Alignment
     PUT(WSIZE + heap_s, PACK(DSIZE, 1));        // Prologue header
     PUT((WSIZE << 1) + heap_s, PACK(DSIZE, 1)); // Prologue footer
-    PUT(3 * WSIZE + heap_s, PACK(0, 1));        // Epilogue header
+    PUT(3 * WSIZE + heap_s, PACK(0, 1) | PREV_ALLOC); // Epilogue header
 }
 
 /*
@@ -152,117 +491,919 @@ static void *extend_heap(size_t words) {
     void *bp;
 	bp = mem_sbrk(ALIGN(words));
     if(bp == ((void *) -1)) return NULL;
+    stats.sbrk_calls++;
+    stats.peak_heap_bytes = MAX(stats.peak_heap_bytes, mem_heapsize());
 
-    SET_HDR(bp, ALIGN(words), 0);           // Set new block header, footer (mark free)
+    SET_HDR(bp, ALIGN(words), 0);           // Set new block header, footer (mark free), old epilogue has PREV_ALLOC
 	SET_FTR(bp, ALIGN(words), 0);
-    SET_HDR(NEXT_BLKP(bp), 0, 1);               // Set epilogue header (mark end)
-    insert(ALIGN(words), bp);      // insert
+    NEW_HDR(NEXT_BLKP(bp), 0, 0, 1);            // Set epilogue header (mark end)
 
-    return coalesce(bp);                        // coalesce and return
+    return coalesce(bp);                        // coalesce, insert and return
 }
 
 /*
  * Extends heap if needed, for a given block pointer and size
  */
-static char *extend_heap_if_needed(char *bp, size_t asize, int *left) {
+static char *extend_heap_if_needed(char *bp, size_t asize) {
     if(bp == NULL) bp = extend_heap(MAX(asize, CHUNKSIZE));
-    else if (left && *left < 0) {
-        int extendsize = MAX(CHUNKSIZE, -(*left));
-        if(extend_heap(extendsize) == NULL) return NULL;
-        *left += extendsize;
-    }
     return bp;
 }
 
 int mm_init(void) {
+    int ret = -1;
+
+    pthread_mutex_lock(&heap_lock);
+    heap_gen++;                         // blocks cached by any thread belong to the old heap
+    __atomic_store_n(&mmap_threshold, MMAP_THRESHOLD_MIN, __ATOMIC_RELAXED);
+    __atomic_store_n(&trim_threshold, MMAP_THRESHOLD_MIN << 1, __ATOMIC_RELAXED);
+
+    const char *policy = getenv("MM_POLICY");
+    fit_policy = FIT_SEG;
+    for (int i = 0; policy && i < (int)(sizeof(fit_policy_names) / sizeof(fit_policy_names[0])); i++)
+        if (strcmp(policy, fit_policy_names[i]) == 0) fit_policy = i;
+    const char *defer = getenv("MM_DEFER");
+    defer_coalesce = defer && strcmp(defer, "0") != 0;
+
+#ifdef MM_DEBUG
+    dbg_reset();                        // quarantined blocks belong to the old heap
+#endif
     char *heap_s = init_heap_space();
     if(heap_s != (void *) -1) {
         create_heap(heap_s);
-        if(extend_heap(1 << 6) != 0) return 0;
+        if(extend_heap(1 << 6) != 0) ret = 0;
     }
-    return -1;
+    pthread_mutex_unlock(&heap_lock);
+    return ret;
+}
+
+/*
+ * Returns size class index of a block size
+ */
+static int size_class(size_t size) {
+    int class = (31 - __builtin_clz((unsigned int) size)) - 4;
+    return MIN(MAX(class, 0), NUM_CLASSES - 1);
 }
 
 /*
- * Returns pointer to adequate block for the size by looping free list
+ * Returns pointer to adequate free block for the size according to fit_policy, or NULL
  */
 static char *fit_block(size_t asize) {
-    char *bp = heap_listp;
-    while (bp && BLOCK_SIZE(bp) < asize) bp = NEXT_FREEP(bp);
+    int class = size_class(asize);
+    char *bp;
 
-    return bp;
+    fit_searches++;
+    if (asize >= TREE_MIN) return fit_policy == FIT_FIRST ? tree_first_fit(asize) : tree_lower_bound(asize);
+
+    switch (fit_policy) {
+    case FIT_FIRST: {
+        char *tbp = tree_first_fit(asize);
+        bp = first_fit(asize, class);
+        return !bp || (tbp && tbp < bp) ? tbp : bp;
+    }
+    case FIT_NEXT:
+        if (rover && BLOCK_SIZE(rover) >= asize) {  // rover itself may fit already
+            fit_steps++;
+            return rover;
+        }
+        bp = scan_fit(asize, rover ? MAX(size_class(BLOCK_SIZE(rover)), class) : class, rover);
+        if (!bp) bp = scan_fit(asize, class, NULL);     // wrap around
+        return bp ? bp : tree_lower_bound(asize);
+    case FIT_BEST:
+        bp = best_fit(asize, class);
+        return bp ? bp : tree_lower_bound(asize);
+    default:
+        break;
+    }
+
+    // seg: first fit in its own class, else head of the next non-empty class (always fits)
+    for (bp = seg_lists[class]; bp; bp = NEXT_FREEP(bp)) {
+        fit_steps++;
+        if (BLOCK_SIZE(bp) >= asize) return bp;
+    }
+
+    unsigned int larger = seg_bitmap & ~((2u << class) - 1);
+    if (!larger) return tree_lower_bound(asize);
+    fit_steps++;
+    return seg_lists[__builtin_ctz(larger)];
+}
+
+/*
+ * Returns lowest-addressed block that fits (every list from class up is scanned)
+ */
+static char *first_fit(size_t asize, int class) {
+    unsigned int classes = seg_bitmap & ~((1u << class) - 1);
+    char *first = NULL;
+
+    while (classes) {
+        int c = __builtin_ctz(classes);
+        classes &= classes - 1;
+        for (char *bp = seg_lists[c]; bp; bp = NEXT_FREEP(bp)) {
+            fit_steps++;
+            if (BLOCK_SIZE(bp) >= asize && (!first || bp < first)) first = bp;
+        }
+    }
+    return first;
+}
+
+/*
+ * Returns first block that fits in list order, scanning class lists from class up,
+ * starting at free block start (in class) if given
+ */
+static char *scan_fit(size_t asize, int class, char *start) {
+    unsigned int classes = seg_bitmap & ~((1u << class) - 1);
+
+    while (classes) {
+        int c = __builtin_ctz(classes);
+        char *bp = start && c == class ? start : seg_lists[c];
+        classes &= classes - 1;
+        for (; bp; bp = NEXT_FREEP(bp)) {
+            fit_steps++;
+            if (BLOCK_SIZE(bp) >= asize) return bp;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns smallest block that fits: the best in its own class, else the best of
+ * the next non-empty class (every block there fits)
+ */
+static char *best_fit(size_t asize, int class) {
+    unsigned int classes = seg_bitmap & ~((1u << class) - 1);
+    char *best = NULL;
+
+    while (classes && best == NULL) {
+        int c = __builtin_ctz(classes);
+        classes &= classes - 1;
+        for (char *bp = seg_lists[c]; bp; bp = NEXT_FREEP(bp)) {
+            fit_steps++;
+            if (BLOCK_SIZE(bp) >= asize && (!best || BLOCK_SIZE(bp) < BLOCK_SIZE(best))) {
+                best = bp;
+                if (BLOCK_SIZE(bp) == asize) return bp;     // exact fit, can't do better
+            }
+        }
+    }
+    return best;
+}
+
+/*
+ * Tree order: by size, then by address (so every key is unique)
+ */
+static int tree_before(char *a, char *b) {
+    size_t sa = BLOCK_SIZE(a), sb = BLOCK_SIZE(b);
+    return sa < sb || (sa == sb && a < b);
+}
+
+/*
+ * Rotates x above its parent
+ */
+static void tree_rotate(char *x) {
+    char *p = PARENT(x), *g = PARENT(p);
+
+    if (LEFT(p) == x) {
+        SET_LEFT(p, RIGHT(x));
+        if (RIGHT(x)) SET_PARENT(RIGHT(x), p);
+        SET_RIGHT(x, p);
+    } else {
+        SET_RIGHT(p, LEFT(x));
+        if (LEFT(x)) SET_PARENT(LEFT(x), p);
+        SET_LEFT(x, p);
+    }
+    SET_PARENT(p, x);
+    SET_PARENT(x, g);
+    if (g == NULL) tree_root = x;
+    else if (LEFT(g) == p) SET_LEFT(g, x);
+    else SET_RIGHT(g, x);
+}
+
+static void tree_insert(char *bp) {
+    char *parent = NULL, *cur = tree_root;
+
+    while (cur) {
+        parent = cur;
+        cur = tree_before(bp, cur) ? LEFT(cur) : RIGHT(cur);
+    }
+    SET_LEFT(bp, NULL);
+    SET_RIGHT(bp, NULL);
+    SET_PARENT(bp, parent);
+    COLOR(bp) = RED;
+    if (parent == NULL) tree_root = bp;
+    else if (tree_before(bp, parent)) SET_LEFT(parent, bp);
+    else SET_RIGHT(parent, bp);
+
+    // fix red bp under red parent (the root is black, so a red parent has a parent)
+    while (IS_RED(PARENT(bp))) {
+        char *p = PARENT(bp), *g = PARENT(p);
+        char *uncle = LEFT(g) == p ? RIGHT(g) : LEFT(g);
+
+        if (IS_RED(uncle)) {            // recolor, continue from g
+            COLOR(p) = COLOR(uncle) = BLACK;
+            COLOR(g) = RED;
+            bp = g;
+            continue;
+        }
+        if ((LEFT(g) == p) != (LEFT(p) == bp)) {    // inner child: rotate it outside first
+            tree_rotate(bp);
+            bp = p;
+            p = PARENT(bp);
+        }
+        COLOR(p) = BLACK;
+        COLOR(g) = RED;
+        tree_rotate(p);
+    }
+    COLOR(tree_root) = BLACK;
+}
+
+/*
+ * Puts subtree v in the place of subtree u
+ */
+static void tree_transplant(char *u, char *v) {
+    char *p = PARENT(u);
+
+    if (p == NULL) tree_root = v;
+    else if (LEFT(p) == u) SET_LEFT(p, v);
+    else SET_RIGHT(p, v);
+    if (v) SET_PARENT(v, p);
+}
+
+static void tree_delete(char *bp) {
+    char *x, *xp, *y = bp;
+    int removed_color = COLOR(bp);
+
+    if (LEFT(bp) == NULL || RIGHT(bp) == NULL) {
+        x = LEFT(bp) ? LEFT(bp) : RIGHT(bp);
+        xp = PARENT(bp);
+        tree_transplant(bp, x);
+    } else {                            // replace bp by its successor y
+        for (y = RIGHT(bp); LEFT(y); y = LEFT(y));
+        removed_color = COLOR(y);
+        x = RIGHT(y);
+        if (PARENT(y) == bp) {
+            xp = y;
+        } else {
+            xp = PARENT(y);
+            tree_transplant(y, x);
+            SET_RIGHT(y, RIGHT(bp));
+            SET_PARENT(RIGHT(y), y);
+        }
+        tree_transplant(bp, y);
+        SET_LEFT(y, LEFT(bp));
+        SET_PARENT(LEFT(y), y);
+        COLOR(y) = COLOR(bp);
+    }
+    if (removed_color == BLACK) tree_delete_fixup(x, xp);
+}
+
+/*
+ * Restores black heights after a black node was removed above x (possibly NULL), child of xp
+ */
+static void tree_delete_fixup(char *x, char *xp) {
+    while (x != tree_root && !IS_RED(x)) {
+        int left = LEFT(xp) == x;       // a NULL x is the left child iff LEFT(xp) is NULL too
+        char *w = left ? RIGHT(xp) : LEFT(xp);
+
+        if (IS_RED(w)) {
+            COLOR(w) = BLACK;
+            COLOR(xp) = RED;
+            tree_rotate(w);
+            w = left ? RIGHT(xp) : LEFT(xp);
+        }
+        char *near = left ? LEFT(w) : RIGHT(w), *far = left ? RIGHT(w) : LEFT(w);
+        if (!IS_RED(near) && !IS_RED(far)) {
+            COLOR(w) = RED;
+            x = xp;
+            xp = PARENT(x);
+            continue;
+        }
+        if (!IS_RED(far)) {
+            COLOR(near) = BLACK;
+            COLOR(w) = RED;
+            tree_rotate(near);
+            far = w;
+            w = near;
+        }
+        COLOR(w) = COLOR(xp);
+        COLOR(xp) = BLACK;
+        COLOR(far) = BLACK;
+        tree_rotate(w);
+        x = tree_root;
+    }
+    if (x) COLOR(x) = BLACK;
+}
+
+/*
+ * Returns smallest (then lowest-addressed) free block of at least asize bytes (best fit)
+ */
+static char *tree_lower_bound(size_t asize) {
+    char *cur = tree_root, *best = NULL;
+
+    while (cur) {
+        fit_steps++;
+        if (BLOCK_SIZE(cur) >= asize) {
+            best = cur;
+            cur = LEFT(cur);
+        } else {
+            cur = RIGHT(cur);
+        }
+    }
+    return best;
+}
+
+/*
+ * In-order successor of bp
+ */
+static char *tree_next(char *bp) {
+    if (RIGHT(bp)) {
+        for (bp = RIGHT(bp); LEFT(bp); bp = LEFT(bp));
+        return bp;
+    }
+    while (PARENT(bp) && RIGHT(PARENT(bp)) == bp) bp = PARENT(bp);
+    return PARENT(bp);
+}
+
+/*
+ * Lowest-addressed block in the tree that fits (visits every block that fits)
+ */
+static char *tree_first_fit(size_t asize) {
+    char *first = NULL;
+
+    for (char *bp = tree_lower_bound(asize); bp; bp = tree_next(bp)) {
+        fit_steps++;
+        if (!first || bp < first) first = bp;
+    }
+    return first;
+}
+
+/*
+ * Returns calling thread's tcache, resetting it if the heap was re-initialized
+ */
+static struct tcache *tcache_get(void) {
+    struct tcache *tc = &tcache;
+    unsigned int gen = __atomic_load_n(&heap_gen, __ATOMIC_ACQUIRE);
+
+    if (tc->gen != gen) {
+        memset(tc->bins, 0, sizeof(tc->bins));
+        memset(tc->counts, 0, sizeof(tc->counts));
+        memset(&tc->stats, 0, sizeof(tc->stats));
+        __atomic_store_n(&tc->gen, gen, __ATOMIC_RELAXED);
+    }
+    if (!tc->registered) {
+        tc->registered = 1;             // first, pthread_setspecific may call malloc (the shim's is ours)
+        pthread_once(&tcache_once, tcache_key_create);
+        pthread_setspecific(tcache_key, tc);    // non-NULL value so tcache_flush runs at exit
+        pthread_mutex_lock(&heap_lock);
+        tc->next = tcache_list;
+        tcache_list = tc;
+        pthread_mutex_unlock(&heap_lock);
+    }
+    return tc;
+}
+
+static void tcache_key_create(void) {
+    pthread_key_create(&tcache_key, tcache_flush);
+}
+
+/*
+ * Thread exit destructor: returns cached blocks to the heap and the thread's counters
+ * to the global ones
+ */
+static void tcache_flush(void *arg) {
+    struct tcache *tc = arg;
+
+    pthread_mutex_lock(&heap_lock);
+    for (struct tcache **p = &tcache_list; *p; p = &(*p)->next) {
+        if (*p == tc) {
+            *p = tc->next;
+            break;
+        }
+    }
+    tc->registered = 0;                 // a later destructor's malloc registers it again
+    if (tc->gen == heap_gen) {
+        stats_add(&stats, &tc->stats);
+        memset(&tc->stats, 0, sizeof(tc->stats));
+        for (int i = 0; i < TCACHE_BINS; i++) {
+            while (tc->bins[i]) {
+                char *bp = tc->bins[i];
+                tc->bins[i] = TC_NEXT(bp);
+                struct slab *slab = slab_of(bp);
+                if (slab) slab_free(slab, bp);
+                else heap_free(bp);
+            }
+            tc->counts[i] = 0;
+        }
+    }
+    pthread_mutex_unlock(&heap_lock);
 }
 
 /*
  * Allocates block of size bytes
  */
 void *mm_malloc(size_t size) {
-    if (size == 0) return NULL;
+    if (size == 0 || size > PTRDIFF_MAX) return NULL;     // the size rounding below would wrap around
+
+    // slots have no header, heap blocks do
+    size_t asize = size <= SLAB_MAX ? ALIGN(size) : MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+    struct tcache *tc = tcache_get();
+    char *bp;
+
+    if (asize <= TCACHE_MAX) {
+        int bin = TCACHE_BIN(asize);
+        if ((bp = tc->bins[bin]) != NULL) {    // lock-free fast path
+            tc->bins[bin] = TC_NEXT(bp);
+            tc->counts[bin]--;
+            TSTAT_ADD(tc, tcache_hits, 1);
+            STAT_MALLOC(tc, asize, asize);
+            return bp;
+        }
+    } else if (asize >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)) {
+        if ((bp = mmap_alloc(size, ALIGNMENT)) != NULL)    // no lock needed, the heap isn't touched
+            STAT_MALLOC(tc, asize, MMAP_LEN(bp));
+        return bp;
+    }
 
-    size_t asize = MAX(ALIGN(size + DSIZE), DSIZE << 1);
-    char *bp = fit_block(asize);
-    bp = extend_heap_if_needed(bp, asize, NULL);
+    pthread_mutex_lock(&heap_lock);
+    bp = size <= SLAB_MAX ? slab_malloc(asize) : heap_malloc(asize);
+    if (bp != NULL) STAT_MALLOC(tc, asize, size <= SLAB_MAX ? asize : BLOCK_SIZE(bp));
+    CHECK_HEAP();
+    pthread_mutex_unlock(&heap_lock);
+    return bp;
+}
+
+
+/*
+ * Frees memory block pointed by ptr
+ */
+void mm_free(void *bp) {
+    if (bp == NULL) return;
+    struct tcache *tc = tcache_get();
+    if (!IN_HEAP(bp)) {
+        STAT_FREE(tc, MMAP_LEN(bp));
+        mmap_free(bp);
+        return;
+    }
+
+    struct slab *slab = slab_of(bp);
+    size_t size = slab ? slab->size : __atomic_load_n((unsigned int *)HDRP(bp), __ATOMIC_RELAXED) & ~0x7;
+    STAT_FREE(tc, size);
+    if (size <= TCACHE_MAX && (slab || size > SLAB_MAX)) {
+        int bin = TCACHE_BIN(size);
+        if (tc->counts[bin] < TCACHE_COUNT) {  // lock-free fast path
+            TC_NEXT(bp) = tc->bins[bin];
+            tc->bins[bin] = bp;
+            tc->counts[bin]++;
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&heap_lock);
+    if (slab) slab_free(slab, bp);
+    else heap_free(bp);
+    CHECK_HEAP();
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/**
+ * Reallocates memory block pointed by ptr (if NULL, same as malloc)
+ */
+void *mm_realloc(void *ptr, size_t size) {
+    if (ptr == NULL) return mm_malloc(size);
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
+    }
+    if (size > PTRDIFF_MAX) return NULL;    // the size rounding below would wrap around, ptr is kept
+    struct tcache *tc = tcache_get();
+    TSTAT_ADD(tc, reallocs, 1);
+    if (!IN_HEAP(ptr)) {
+        size_t old = MMAP_LEN(ptr);
+        void *newptr = mmap_realloc(ptr, size);
+        if (newptr != NULL) TSTAT_ADD(tc, live_bytes, MMAP_LEN(newptr) - old);    // wraps around when shrinking
+        return newptr;
+    }
+
+    struct slab *slab = slab_of(ptr);
+    if (slab) {                         // slots can't grow: keep it if it fits, else move
+        if (size <= slab->size) return ptr;
+        void *newptr = mm_malloc(size);
+        if (newptr == NULL) return NULL;
+        memcpy(newptr, ptr, slab->size);
+        mm_free(ptr);
+        return newptr;
+    }
+
+    pthread_mutex_lock(&heap_lock);
+    size_t old = BLOCK_SIZE(ptr);
+    void *newptr = heap_realloc(ptr, size);
+    if (newptr != NULL) TSTAT_ADD(tc, live_bytes, block_bytes(newptr) - old);
+    CHECK_HEAP();
+    pthread_mutex_unlock(&heap_lock);
+    return newptr;
+}
+
+/*
+ * Allocates block of size bytes whose address is a multiple of alignment (a power of two):
+ * a slot whose size is a multiple of alignment up to SLAB_ALIGN_MAX, else a block carved
+ * out of a free heap block like a slab is, or an aligned mapping if it is that large
+ */
+void *mm_memalign(size_t alignment, size_t size) {
+    if (alignment <= ALIGNMENT) return mm_malloc(size);
+    if (size == 0 || size > PTRDIFF_MAX || (alignment & (alignment - 1))) return NULL;
+
+    size_t salign = alignment > (DSIZE << 1) ? SLAB_ALIGN_MAX : alignment;     // see SLAB_SLOT_ALIGN
+    size_t ssize = (size + salign - 1) & ~(salign - 1);
+    if (alignment <= SLAB_ALIGN_MAX && ssize <= SLAB_MAX) return mm_malloc(ssize);
+
+    size_t asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+    struct tcache *tc = tcache_get();
+    char *bp;
+    if (asize < size || asize + alignment < asize) return NULL;
+    if (asize >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)) {
+        if ((bp = mmap_alloc(size, alignment)) != NULL) STAT_MALLOC(tc, asize, MMAP_LEN(bp));
+        return bp;
+    }
+
+    pthread_mutex_lock(&heap_lock);
+    bp = heap_malloc_aligned(asize, alignment);
+    if (bp != NULL) STAT_MALLOC(tc, asize, BLOCK_SIZE(bp));
+    CHECK_HEAP();
+    pthread_mutex_unlock(&heap_lock);
+    return bp;
+}
+
+/*
+ * Allocates nmemb elements of size bytes, all zero. Mappings come zero-filled,
+ * and of a heap block only what may have been written to is cleared: the part
+ * below mem_heap_zero() as it was before the call, and the free block links and
+ * footer (at its start and end) the allocator wrote into the fresh part itself
+ */
+void *mm_calloc(size_t nmemb, size_t size) {
+    size_t bytes;
+    char *bp, *zero;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes) || bytes == 0 || bytes > PTRDIFF_MAX) return NULL;
+
+    size_t asize = MAX(ALIGN(bytes + WSIZE), MIN_BLOCK);
+    if (asize < bytes) return NULL;
+    if (bytes <= SLAB_MAX || asize >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)) {
+        if ((bp = mm_malloc(bytes)) != NULL && IN_HEAP(bp)) memset(bp, 0, bytes);
+        return bp;
+    }
+
+    struct tcache *tc = tcache_get();
+    pthread_mutex_lock(&heap_lock);
+    zero = mem_heap_zero();
+    if ((bp = heap_malloc(asize)) != NULL) {
+        char *end = bp + bytes;
+        STAT_MALLOC(tc, asize, BLOCK_SIZE(bp));
+        if (end <= zero + (DSIZE << 1)) {
+            memset(bp, 0, bytes);
+        } else {
+            char *clean = MAX(zero, bp) + (DSIZE << 1);   // links of a free block that started there
+            char *ftr = MAX(clean, FTRP(bp));                // footer, if the block took it all
+            memset(bp, 0, clean - bp);
+            if (ftr < end) memset(ftr, 0, end - ftr);
+        }
+    }
+    CHECK_HEAP();
+    pthread_mutex_unlock(&heap_lock);
+    return bp;
+}
+
+/*
+ * Allocates block of asize bytes (heap_lock held)
+ */
+static void *heap_malloc(size_t asize) {
+    char *bp;
+
+    if (quick_count && asize < TREE_MIN && (bp = quick_bins[QUICK_BIN(asize)]) != NULL) {   // exact fit, still allocated
+        quick_bins[QUICK_BIN(asize)] = NEXT_FREEP(bp);
+        quick_count--;
+        SET_HDR(bp, asize, 1);
+        return bp;
+    }
+    bp = fit_block(asize);
+    if (bp == NULL && quick_count) {    // miss: merge the quick bins and look again
+        quick_consolidate();
+        bp = fit_block(asize);
+    }
+    bp = extend_heap_if_needed(bp, asize);
 
     if(bp == NULL) return NULL;
 
     return place(bp, asize);
 }
 
+/*
+ * Frees block bp back to the free lists, or into its quick bin under MM_DEFER (heap_lock held)
+ */
+static void heap_free(void *bp) {
+    size_t size = BLOCK_SIZE(bp);
+
+    if (defer_coalesce && size < TREE_MIN) {
+        SET_NEXT_FREEP(bp, quick_bins[QUICK_BIN(size)]);
+        quick_bins[QUICK_BIN(size)] = bp;
+        if (++quick_count >= QUICK_LIMIT) quick_consolidate();
+        return;
+    }
+    SET_HDR(bp, size, 0);
+    SET_FTR(bp, size, 0);
+    trim_heap(coalesce(bp));
+}
 
 /*
- * Frees memory block pointed by ptr
+ * Frees every block in the quick bins, coalescing them with their free neighbours
+ * (which may have been binned themselves) (heap_lock held)
  */
-void mm_free(void *bp) {
+static void quick_consolidate(void) {
+    for (int bin = 0; bin < QUICK_BINS && quick_count; bin++) {
+        char *bp = quick_bins[bin];
+        while (bp) {
+            char *next = NEXT_FREEP(bp);
+            size_t size = BLOCK_SIZE(bp);
+            SET_HDR(bp, size, 0);
+            SET_FTR(bp, size, 0);
+            trim_heap(coalesce(bp));
+            quick_count--;
+            bp = next;
+        }
+        quick_bins[bin] = NULL;
+    }
+}
+
+/*
+ * Gives the end of the heap back to the system if free block bp is last and
+ * at least trim_threshold bytes, keeping TRIM_PAD bytes (heap_lock held)
+ */
+static void trim_heap(char *bp) {
     size_t size = BLOCK_SIZE(bp);
+
+    if (BLOCK_SIZE(NEXT_BLKP(bp)) != 0 || size < __atomic_load_n(&trim_threshold, __ATOMIC_RELAXED))
+        return;
+
+    size_t release = (size - TRIM_PAD) & ~(mem_pagesize() - 1);
+    delete(bp);
+    size -= release;
     SET_HDR(bp, size, 0);
-	SET_FTR(bp, size, 0);
+    SET_FTR(bp, size, 0);
+    mem_sbrk(-(int) release);
+    stats.sbrk_calls++;
+    NEW_HDR(NEXT_BLKP(bp), 0, 0, 1);            // new epilogue
     insert(size, bp);
-    coalesce(bp);
 }
 
-/**
- * Reallocates memory block pointed by ptr (if NULL, same as malloc)
+/*
+ * Returns the first payload address in free block bp aligned to align bytes that
+ * leaves either no gap or room for a free block before it
  */
-void *mm_realloc(void *ptr, size_t size) {
-    if (!size) return NULL;
+static char *align_in_block(char *bp, size_t align) {
+    char *abp = (char *)(((uintptr_t)bp + align - 1) & ~(uintptr_t)(align - 1));
+    if (abp != bp && abp - bp < MIN_BLOCK) abp += align;
+    return abp;
+}
 
-    size_t asize = (size <= DSIZE) ? (DSIZE << 1) + (1 << 7) : ALIGN(size + DSIZE) + (1 << 7);
+/*
+ * Allocates block of asize bytes whose payload is aligned to align bytes (heap_lock held).
+ * Looks for a free block that holds such a block first, so aligned blocks carved
+ * one after another pack together instead of each leaving a gap behind
+ */
+static void *heap_malloc_aligned(size_t asize, size_t align) {
+    unsigned int classes = seg_bitmap & ~((1u << size_class(asize)) - 1);
+    char *bp = NULL, *abp;
+
+    while (classes && bp == NULL) {
+        int class = __builtin_ctz(classes);
+        classes &= classes - 1;
+        for (bp = seg_lists[class]; bp; bp = NEXT_FREEP(bp))
+            if (align_in_block(bp, align) + asize <= bp + BLOCK_SIZE(bp)) break;
+    }
+    for (char *tbp = bp ? NULL : tree_lower_bound(asize); tbp; tbp = tree_next(tbp)) {
+        if (align_in_block(tbp, align) + asize <= tbp + BLOCK_SIZE(tbp)) {
+            bp = tbp;
+            break;
+        }
+    }
+    if (bp == NULL && quick_count) {    // merge the quick bins and try again
+        quick_consolidate();
+        return heap_malloc_aligned(asize, align);
+    }
+    if (bp == NULL && (bp = extend_heap(asize + align + MIN_BLOCK)) == NULL) return NULL;
 
-    if (BLOCK_SIZE(ptr) >= asize) return ptr;
+    delete(bp);
+    size_t csize = BLOCK_SIZE(bp);
+    abp = align_in_block(bp, align);
+    if (abp != bp) {                    // leading gap stays free
+        size_t lead = abp - bp;
+        SET_HDR(bp, lead, 0);
+        SET_FTR(bp, lead, 0);
+        insert(lead, bp);
+        NEW_HDR(abp, csize - lead, 0, 1);
+        csize -= lead;
+    }
+    resize_block(abp, csize, asize);    // and so does the tail
+    return abp;
+}
 
-    if (NEXT_NOT_ALLOC(ptr)) {
-        int left = BLOCK_SIZE(ptr) + BLOCK_SIZE(NEXT_BLKP(ptr)) - asize;
-        ptr = extend_heap_if_needed(ptr, asize, &left);
+/*
+ * Returns the slab bp is a slot of, or NULL if bp is a heap block
+ */
+static struct slab *slab_of(void *bp) {
+    size_t page = SLAB_PAGE(bp);
 
-        if(ptr == NULL) return NULL;  // If extend_heap_if_needed failed
+    if (!((__atomic_load_n(&slab_pages[page >> 6], __ATOMIC_RELAXED) >> (page & 63)) & 1))
+        return NULL;
+    return (struct slab *)((char *)mem_heap_lo() + page * SLAB_SIZE);
+}
 
-        delete(NEXT_BLKP(ptr));
-        SET_HDR(ptr, asize + left, 1);
-		SET_FTR(ptr, asize + left, 1);
-        return ptr;
+/*
+ * Allocates a slot of ssize bytes (a multiple of 8 up to SLAB_MAX), carving a new slab
+ * if no slab of that size has a free slot (heap_lock held)
+ */
+static void *slab_malloc(size_t ssize) {
+    int class = SLAB_CLASS(ssize);
+    struct slab *slab = slab_lists[class];
+
+    if (slab == NULL) {
+        if ((slab = heap_malloc_aligned(SLAB_SIZE, SLAB_SIZE)) == NULL) return NULL;
+        slab->next = slab->prev = NULL;
+        slab->size = ssize;
+        slab->nslots = slab->nfree = (SLAB_SIZE - WSIZE - SLAB_FIRST(ssize)) / ssize;
+        slab->hint = 0;
+        memset(slab->map, 0, sizeof(slab->map));
+        for (int i = 0; i < slab->nslots; i += 64)
+            slab->map[i >> 6] = slab->nslots - i >= 64 ? ~0ULL : (1ULL << (slab->nslots - i)) - 1;
+        size_t page = SLAB_PAGE(slab);
+        __atomic_fetch_or(&slab_pages[page >> 6], 1ULL << (page & 63), __ATOMIC_RELAXED);
+        slab_lists[class] = slab;
     }
 
-    size_t old_size = BLOCK_SIZE(ptr);
-    size_t copy_size = MIN(old_size, size);
+    while (slab->map[slab->hint] == 0) slab->hint++;
+    int slot = (slab->hint << 6) + __builtin_ctzll(slab->map[slab->hint]);
+    slab->map[slab->hint] &= slab->map[slab->hint] - 1;
 
-    // Temporarily save the data
-    char *temp_data = mm_malloc(copy_size); // can change to malloc
-    memcpy(temp_data, ptr, copy_size);
+    if (--slab->nfree == 0) {           // full: off the list
+        slab_lists[class] = slab->next;
+        if (slab->next) slab->next->prev = NULL;
+    }
+    return (char *)slab + SLAB_FIRST(ssize) + slot * ssize;
+}
 
-    // Free the old block
-    mm_free(ptr);
+/*
+ * Returns slot bp to its slab, and the slab to the heap once it is empty
+ * unless it is the last one of its size with free slots (heap_lock held)
+ */
+static void slab_free(struct slab *slab, void *bp) {
+    int class = SLAB_CLASS(slab->size);
+    int slot = ((char *)bp - (char *)slab - SLAB_FIRST(slab->size)) / slab->size;
+
+    slab->map[slot >> 6] |= 1ULL << (slot & 63);
+    slab->hint = MIN(slab->hint, slot >> 6);
+
+    if (slab->nfree++ == 0) {           // was full: back on the list
+        slab->prev = NULL;
+        slab->next = slab_lists[class];
+        if (slab->next) slab->next->prev = slab;
+        slab_lists[class] = slab;
+    }
+    if (slab->nfree == slab->nslots && (slab->prev || slab->next)) {
+        if (slab->prev) slab->prev->next = slab->next;
+        else slab_lists[class] = slab->next;
+        if (slab->next) slab->next->prev = slab->prev;
+
+        size_t page = SLAB_PAGE(slab);
+        __atomic_fetch_and(&slab_pages[page >> 6], ~(1ULL << (page & 63)), __ATOMIC_RELAXED);
+        heap_free(slab);
+    }
+}
+
+/*
+ * Gives a block of size bytes its own mapping, with the payload aligned to align bytes
+ * (a power of two; the unused lead in front of the header is never touched)
+ */
+static void *mmap_alloc(size_t size, size_t align) {
+    size_t page = mem_pagesize();
+    size_t pad = align > MMAP_HDR ? align - MMAP_HDR : 0;
+    size_t len = (size + MMAP_HDR + pad + page - 1) & ~(page - 1);
+    char *base, *bp;
+
+    if (len < size || (base = mem_mmap(len)) == NULL) return NULL;
+    STAT_ADD(mmap_bytes, len);
+    bp = (char *)(((uintptr_t)base + MMAP_HDR + align - 1) & ~(uintptr_t)(align - 1));
+    MMAP_LEN(bp) = len;
+    PUT(bp - DSIZE, bp - MMAP_HDR - base);                  // MMAP_LEAD
+    PUT(HDRP(bp), PACK(0, 1) | PREV_ALLOC);                 // never read by the heap code, like an epilogue
+    return bp;
+}
+
+/*
+ * Unmaps a mapped block, raising the mmap threshold to its size (dynamic threshold)
+ */
+static void mmap_free(void *bp) {
+    size_t len = MMAP_LEN(bp);
 
-    // Allocate new block
-    void *newptr = mm_malloc(size);
-    if (newptr != NULL) {
-        // Copy the data to the new block
-        memcpy(newptr, temp_data, copy_size);
+    if (len > __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) && len <= MMAP_THRESHOLD_MAX) {
+        __atomic_store_n(&mmap_threshold, len, __ATOMIC_RELAXED);
+        __atomic_store_n(&trim_threshold, len << 1, __ATOMIC_RELAXED);
     }
+    STAT_SUB(mmap_bytes, len);
+    mem_munmap(MMAP_BASE(bp), len);
+}
 
-    // Free the temp buffer
-    mm_free(temp_data);
+/*
+ * Resizes a mapped block with mremap, which moves pages instead of copying them
+ */
+static void *mmap_realloc(void *bp, size_t size) {
+    size_t page = mem_pagesize();
+    size_t len = MMAP_LEN(bp), lead = MMAP_LEAD(bp);
+    size_t new_len = (size + MMAP_HDR + lead + page - 1) & ~(page - 1);
+    char *base;
+
+    if (new_len < size) return NULL;
+    if (new_len == len) return bp;
+    if ((base = mem_mremap(MMAP_BASE(bp), len, new_len)) == NULL) return NULL;
+    STAT_ADD(mmap_bytes, new_len - len);    // wraps around when shrinking
+    bp = base + lead + MMAP_HDR;            // mremap keeps the page offset, so the alignment too
+    MMAP_LEN(bp) = new_len;
+    return bp;
+}
 
-    return newptr;
+/*
+ * Resizes block ptr to hold size bytes (heap_lock held)
+ */
+static void *heap_realloc(void *ptr, size_t size) {
+    if (size > PTRDIFF_MAX) return NULL;    // asize would wrap around and look like a shrink
+    size_t asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK);
+    size_t old = BLOCK_SIZE(ptr);
+    int realloced = GET_REALLOCED(HDRP(ptr));
+
+    if (asize <= old) {     // shrink in place, giving the tail back
+        resize_block(ptr, old, asize);
+        if (realloced) SET_REALLOCED(ptr);
+        return ptr;
+    }
+
+    // adaptive growth: first growth is exact, a block that keeps growing gets at least
+    // 1.5x (or one more step of the same size) so repeated reallocs stay in place
+    size_t grow = realloced ? ALIGN(asize + MAX(asize - old, asize >> 1)) : asize;
+
+    char *next = NEXT_BLKP(ptr);
+    size_t next_free = GET_ALLOC(HDRP(next)) ? 0 : BLOCK_SIZE(next);
+    int at_end = !BLOCK_SIZE(next) || (next_free && !BLOCK_SIZE(NEXT_BLKP(next)));
+    char *bp = NULL;
+    size_t avail = 0;
+
+    if (old + next_free >= asize) {                     // grow into free next block
+        delete(next);
+        bp = ptr;
+        avail = old + next_free;
+    } else if (at_end) {                                // grow at heap end by exactly what is missing
+        if (extend_heap(MAX(grow - old - next_free, MIN_BLOCK)) == NULL) return NULL;
+        next = NEXT_BLKP(ptr);
+        delete(next);
+        bp = ptr;
+        avail = old + BLOCK_SIZE(next);
+    } else if (!GET_PREV_ALLOC(HDRP(ptr))) {            // grow into free prev (and next) block
+        char *prev = PREV_BLKP(ptr);
+        if (BLOCK_SIZE(prev) + old + next_free >= asize) {
+            delete(prev);
+            if (next_free) delete(next);
+            avail = BLOCK_SIZE(prev) + old + next_free;
+            SET_HDR(prev, avail, 1);
+            memmove(prev, ptr, old - WSIZE);
+            bp = prev;
+        }
+    }
+
+    if (bp == NULL) {                                   // no room around it: move to a new block
+        if (grow >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED)) {
+            if ((bp = mmap_alloc(grow - WSIZE, ALIGNMENT)) == NULL) return NULL;
+            memcpy(bp, ptr, old - WSIZE);
+            heap_free(ptr);
+            return bp;                                  // mapped blocks carry no realloc history
+        }
+        if ((bp = heap_malloc(grow)) == NULL) return NULL;
+        memcpy(bp, ptr, old - WSIZE);
+        heap_free(ptr);
+    } else {
+        resize_block(bp, avail, avail >= grow ? grow : asize);
+    }
+
+    SET_REALLOCED(bp);
+    return bp;
+}
+
+/*
+ * Sets allocated block bp, owning csize bytes, to size asize, freeing the tail if it can be split
+ */
+static void resize_block(char *bp, size_t csize, size_t asize) {
+    if (csize - asize < MIN_BLOCK) {
+        SET_HDR(bp, csize, 1);
+        MARK_NEXT_ALLOC(bp);
+        return;
+    }
+    SET_HDR(bp, asize, 1);
+    NEW_HDR(NEXT_BLKP(bp), csize - asize, 1, 0);
+    SET_FTR(NEXT_BLKP(bp), csize - asize, 0);
+    coalesce(NEXT_BLKP(bp));
 }
 
 
@@ -274,10 +1415,9 @@ static void *place(void *bp, size_t asize) {
 
     size_t csize = BLOCK_SIZE(bp);
     size_t free_left = csize - asize;
-    size_t min_block_size = DSIZE << 1;
-
-    if (min_block_size >= free_left) {
-        asize = csize; // can't be split, allocate entire block
+    if (free_left < MIN_BLOCK) {
+        SET_HDR(bp, csize, 1); // can't be split, allocate entire block
+        MARK_NEXT_ALLOC(bp);
     } else if (asize < PLACE_THRESHOLD) {
         SPLIT_BLK(bp, asize, free_left);
     } else {
@@ -286,85 +1426,79 @@ static void *place(void *bp, size_t asize) {
 		SET_FTR(bp, free_left, 0);
         insert(free_left, bp);
         bp = NEXT_BLKP(bp);
+        NEW_HDR(bp, asize, 0, 1);
+        MARK_NEXT_ALLOC(bp);
     }
 
-    SET_HDR(bp, asize, 1);
-	SET_FTR(bp, asize, 1);
     return bp;
 }
 
 
 /*
- * Finds free block, and insert (explicit list implementation)
+ * Inserts free block at head of its size class list (segregated explicit list implementation)
  */
 static void insert(size_t size, char *ptr) {
-    char *cur_ptr = heap_listp;
-    char *prev_ptr = NULL;
-
-    /* Find place to insert */
-    while (cur_ptr && BLOCK_SIZE(cur_ptr) < size) {
-        prev_ptr = cur_ptr;
-        cur_ptr = NEXT_FREEP(cur_ptr);
-    }
-    /* NOT start of list */
-    if(prev_ptr != NULL) {
-        SET(ptr + WSIZE, prev_ptr);
-        SET(prev_ptr, ptr);
-        if(cur_ptr != NULL) {
-            SET(ptr, cur_ptr);
-            SET(cur_ptr + WSIZE, ptr);
-        } else SET(ptr, NULL);
-    }
-        /* start of list */
-    else {
-        heap_listp = ptr;
-        SET(ptr + WSIZE, NULL);
-        if(cur_ptr != NULL) {      // NOT the only element in list
-            SET(ptr, cur_ptr);
-            SET(cur_ptr + WSIZE, ptr);
-        } else SET(ptr, NULL); // only element in list
+    if (size >= TREE_MIN) {
+        tree_insert(ptr);
+        return;
     }
+
+    int class = size_class(size);
+    char *head = seg_lists[class];
+
+    SET_NEXT_FREEP(ptr, head);
+    SET_PREV_FREEP(ptr, NULL);
+    if (head != NULL) SET_PREV_FREEP(head, ptr); // NOT the only element in list
+    seg_lists[class] = ptr;
+    seg_bitmap |= 1u << class;
 }
 
 
 /*
- * Finds blocks by case, and deletes it
+ * Unlinks free block from its size class list (must be called before its size changes)
  */
 static void delete(char *ptr) {
-    if (PREV_FREEP(ptr) != NULL) { // Not first node
-        SET(PREV_FREEP(ptr), NEXT_FREEP(ptr));
-        if (NEXT_FREEP(ptr)) SET(NEXT_FREEP(ptr) + WSIZE, PREV_FREEP(ptr)); // Not last node
-    } else { // first node
-        heap_listp = NEXT_FREEP(ptr);
-        if (heap_listp) SET(heap_listp + WSIZE, NULL); // only node
+    if (BLOCK_SIZE(ptr) >= TREE_MIN) {
+        tree_delete(ptr);
+        return;
     }
+
+    int class = size_class(BLOCK_SIZE(ptr));
+
+    if (ptr == rover) rover = NEXT_FREEP(ptr);  // next search resumes after it
+
+    if (PREV_FREEP(ptr) != NULL) SET_NEXT_FREEP(PREV_FREEP(ptr), NEXT_FREEP(ptr));   // Not first node
+    else seg_lists[class] = NEXT_FREEP(ptr);                                        // first node
+    if (NEXT_FREEP(ptr) != NULL) SET_PREV_FREEP(NEXT_FREEP(ptr), PREV_FREEP(ptr));   // Not last node
+
+    if (seg_lists[class] == NULL) seg_bitmap &= ~(1u << class);
 }
 
 /*
- *  Coalesces physically adjacent free blocks
+ *  Coalesces physically adjacent free blocks, and inserts the result
+ *  (bp itself must not be on a free list yet)
  */
 static void *coalesce(void *bp) {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))); // prev block allocated?
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));       // prev block allocated?
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp))); // next block allocated?
     size_t size = BLOCK_SIZE(bp);                       // size of coalescing block
 
     if (prev_alloc && next_alloc) {         /* Case 1 */
-        return bp;
     } else if (prev_alloc && !next_alloc) { /* Case 2 (next block is free) */
-        delete(bp);
+        stats.coalesce_next++;
         delete(NEXT_BLKP(bp));
         size += BLOCK_SIZE(NEXT_BLKP(bp));
         SET_HDR(bp, size, 0);
         SET_FTR(bp, size, 0);
     } else if (!prev_alloc && next_alloc) { /* Case 3 (prev block is free) */
-        delete(bp);
+        stats.coalesce_prev++;
         delete(PREV_BLKP(bp));
         size += BLOCK_SIZE(PREV_BLKP(bp));
         SET_HDR(PREV_BLKP(bp), size, 0);
         SET_FTR(bp, size, 0);
         bp = PREV_BLKP(bp);
     } else {                                /* Case 4 (both blocks are free) */
-        delete(bp);
+        stats.coalesce_both++;
         delete(PREV_BLKP(bp));
         delete(NEXT_BLKP(bp));
         size += BLOCK_SIZE(PREV_BLKP(bp)) +
@@ -374,7 +1508,453 @@ static void *coalesce(void *bp) {
         bp = PREV_BLKP(bp);
     }
 
+    MARK_NEXT_FREE(bp);
     insert(size, bp);
 
     return bp;
 }
+
+/*
+ * Checks heap consistency: block alignment and bounds, header/footer agreement,
+ * PREV_ALLOC bits, complete coalescing, that the free lists hold exactly the
+ * free blocks (in their right class or the tree, in order), and slab bookkeeping.
+ * Returns the number of errors found, printed to stderr (heap_lock held)
+ */
+#define HEAP_ERR(...) do { fprintf(stderr, "mm_check: " __VA_ARGS__); errors++; } while (0)
+
+static int heap_check(int verbose) {
+    char *lo = mem_heap_lo(), *hi = mem_heap_hi();
+    char *bp = lo + (DSIZE << 1);
+    int errors = 0, prev_alloc = 1;
+    size_t nfree = 0, nlisted = 0;
+
+    if (GET(lo + WSIZE) != PACK(DSIZE, 1) || GET(lo + DSIZE) != PACK(DSIZE, 1))
+        HEAP_ERR("bad prologue\n");
+
+    for (; BLOCK_SIZE(bp) > 0; bp = NEXT_BLKP(bp)) {
+        size_t size = BLOCK_SIZE(bp);
+        int alloc = GET_ALLOC(HDRP(bp));
+
+        if (verbose)
+            fprintf(stderr, "%p: size %zu %s%s\n", (void *)bp, size, alloc ? "allocated" : "free",
+                    alloc && slab_of(bp) ? " (slab)" : "");
+        if ((uintptr_t)bp % ALIGNMENT) HEAP_ERR("%p: payload not aligned\n", (void *)bp);
+        if (size % ALIGNMENT || size < MIN_BLOCK) HEAP_ERR("%p: bad size %zu\n", (void *)bp, size);
+        if (bp + size - WSIZE > hi + 1) {
+            HEAP_ERR("%p: block runs past the heap end\n", (void *)bp);
+            return errors;
+        }
+        if (!GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc)
+            HEAP_ERR("%p: PREV_ALLOC bit says %d, previous block is %d\n", (void *)bp, !!GET_PREV_ALLOC(HDRP(bp)), prev_alloc);
+        if (!alloc) {
+            if (GET_SIZE(FTRP(bp)) != size || GET_ALLOC(FTRP(bp)))
+                HEAP_ERR("%p: header and footer differ\n", (void *)bp);
+            if (!prev_alloc) HEAP_ERR("%p: free block not coalesced with previous one\n", (void *)bp);
+            nfree++;
+        }
+        prev_alloc = alloc;
+    }
+    if (HDRP(bp) != hi - WSIZE + 1) HEAP_ERR("epilogue at %p, heap ends at %p\n", (void *)HDRP(bp), (void *)hi);
+    if (!GET_PREV_ALLOC(HDRP(bp)) != !prev_alloc) HEAP_ERR("epilogue PREV_ALLOC bit wrong\n");
+
+    for (int class = 0; class < NUM_CLASSES; class++) {
+        char *prev = NULL;
+        if (!(seg_bitmap & (1u << class)) != !seg_lists[class])
+            HEAP_ERR("class %d: bitmap bit disagrees with list\n", class);
+        for (bp = seg_lists[class]; bp; prev = bp, bp = NEXT_FREEP(bp)) {
+            if (!IN_HEAP(bp) || bp > hi || ++nlisted > nfree) {
+                HEAP_ERR("class %d: list holds %p, not a free heap block (or a cycle)\n", class, (void *)bp);
+                break;
+            }
+            if (GET_ALLOC(HDRP(bp))) HEAP_ERR("class %d: allocated block %p on the list\n", class, (void *)bp);
+            if (size_class(BLOCK_SIZE(bp)) != class) HEAP_ERR("class %d: block %p of size %zu\n", class, (void *)bp, (size_t)BLOCK_SIZE(bp));
+            if (PREV_FREEP(bp) != prev) HEAP_ERR("class %d: %p has a wrong prev link\n", class, (void *)bp);
+        }
+    }
+    if (tree_root && (PARENT(tree_root) || IS_RED(tree_root))) HEAP_ERR("tree root %p has a parent or is red\n", (void *)tree_root);
+    char *first = tree_root, *prev = NULL;
+    int black_height = -1;
+    while (first && LEFT(first)) first = LEFT(first);
+    for (bp = first; bp; prev = bp, bp = tree_next(bp)) {
+        if (!IN_HEAP(bp) || bp > hi || ++nlisted > nfree) {
+            HEAP_ERR("tree holds %p, not a free heap block (or a cycle)\n", (void *)bp);
+            break;
+        }
+        if (GET_ALLOC(HDRP(bp))) HEAP_ERR("tree: allocated block %p\n", (void *)bp);
+        if (BLOCK_SIZE(bp) < TREE_MIN) HEAP_ERR("tree: block %p of size %zu\n", (void *)bp, (size_t)BLOCK_SIZE(bp));
+        if (prev && !tree_before(prev, bp)) HEAP_ERR("tree: %p out of order\n", (void *)bp);
+        if ((LEFT(bp) && PARENT(LEFT(bp)) != bp) || (RIGHT(bp) && PARENT(RIGHT(bp)) != bp))
+            HEAP_ERR("tree: %p has a child with a wrong parent link\n", (void *)bp);
+        if (IS_RED(bp) && (IS_RED(LEFT(bp)) || IS_RED(RIGHT(bp)))) HEAP_ERR("tree: red %p has a red child\n", (void *)bp);
+        if (!LEFT(bp) || !RIGHT(bp)) {  // every path down to a NULL must pass as many black nodes
+            int height = 0;
+            for (char *up = bp; up; up = PARENT(up)) height += !IS_RED(up);
+            if (black_height < 0) black_height = height;
+            else if (height != black_height) HEAP_ERR("tree: black height %d at %p, %d elsewhere\n", height, (void *)bp, black_height);
+        }
+    }
+    if (nlisted != nfree) HEAP_ERR("%zu free blocks in the heap, %zu on the lists and tree\n", nfree, nlisted);
+
+    size_t nquick = 0;
+    for (int bin = 0; bin < QUICK_BINS; bin++) {
+        for (bp = quick_bins[bin]; bp; bp = NEXT_FREEP(bp)) {
+            if (!IN_HEAP(bp) || bp > hi || ++nquick > quick_count) {
+                HEAP_ERR("quick bin %d: holds %p, not a heap block (or a cycle)\n", bin, (void *)bp);
+                break;
+            }
+            if (!GET_ALLOC(HDRP(bp)) || slab_of(bp)) HEAP_ERR("quick bin %d: %p is free or a slab\n", bin, (void *)bp);
+            if (QUICK_BIN(BLOCK_SIZE(bp)) != bin) HEAP_ERR("quick bin %d: block %p of size %zu\n", bin, (void *)bp, (size_t)BLOCK_SIZE(bp));
+        }
+    }
+    if (nquick != quick_count) HEAP_ERR("%zu blocks in the quick bins, count says %u\n", nquick, quick_count);
+
+    for (int class = 0; class < SLAB_CLASSES; class++) {
+        struct slab *prev = NULL;
+        for (struct slab *slab = slab_lists[class]; slab; prev = slab, slab = slab->next) {
+            int nset = 0;
+            for (int i = 0; i < SLAB_WORDS; i++) nset += __builtin_popcountll(slab->map[i]);
+            if (slab_of(slab) != slab) HEAP_ERR("slab %p: page bit not set\n", (void *)slab);
+            if (!GET_ALLOC(HDRP(slab)) || BLOCK_SIZE(slab) < SLAB_SIZE) HEAP_ERR("slab %p: not an allocated slab block\n", (void *)slab);
+            if (SLAB_CLASS(slab->size) != class) HEAP_ERR("slab %p: slot size %d on list %d\n", (void *)slab, slab->size, class);
+            if (slab->nfree == 0 || nset != slab->nfree) HEAP_ERR("slab %p: nfree %d, %d free slots\n", (void *)slab, slab->nfree, nset);
+            if (slab->prev != prev) HEAP_ERR("slab %p: wrong prev link\n", (void *)slab);
+        }
+    }
+    return errors;
+}
+
+/*
+ * Checks heap consistency, see heap_check. Returns the number of errors found
+ */
+int mm_check(int verbose) {
+    pthread_mutex_lock(&heap_lock);
+    int errors = heap_check(verbose);
+    pthread_mutex_unlock(&heap_lock);
+#ifdef MM_DEBUG
+    errors += dbg_check();
+#endif
+    return errors;
+}
+
+/*
+ * Prints a fragmentation profile: free block histogram per power-of-two size, list
+ * lengths and tree size, external fragmentation (1 - largest free block / free bytes)
+ * and how many free blocks fit_block looks at per search
+ */
+void mm_profile(FILE *fp) {
+    size_t count[HIST_BINS] = { 0 }, bytes[HIST_BINS] = { 0 }, lengths[NUM_CLASSES] = { 0 };
+    size_t total = 0, nblocks = 0, largest = 0, ntree = 0;
+    size_t slabs = 0, slots = 0, free_slots = 0;
+    unsigned long searches, steps;
+    unsigned int quick;
+
+    pthread_mutex_lock(&heap_lock);
+    char *tbp = tree_root;
+    while (tbp && LEFT(tbp)) tbp = LEFT(tbp);
+    for (int class = 0; class <= NUM_CLASSES; class++) {
+        // every list, then the tree in order
+        for (char *bp = class < NUM_CLASSES ? seg_lists[class] : tbp; bp;
+             bp = class < NUM_CLASSES ? NEXT_FREEP(bp) : tree_next(bp)) {
+            size_t size = BLOCK_SIZE(bp);
+            int bin = HIST_BIN(size);
+            count[bin]++;
+            bytes[bin] += size;
+            total += size;
+            nblocks++;
+            largest = MAX(largest, size);
+            if (class < NUM_CLASSES) lengths[class]++;
+            else ntree++;
+        }
+    }
+    for (int class = 0; class < SLAB_CLASSES; class++) {
+        for (struct slab *slab = slab_lists[class]; slab; slab = slab->next) {
+            slabs++;
+            slots += slab->nslots;
+            free_slots += slab->nfree;
+        }
+    }
+    searches = fit_searches;
+    steps = fit_steps;
+    quick = quick_count;
+    pthread_mutex_unlock(&heap_lock);
+
+    fprintf(fp, "heap %zu bytes, %zu free in %zu blocks, largest %zu, external fragmentation %.1f%%\n",
+            mem_heapsize(), total, nblocks, largest, total ? 100.0 * (1 - (double)largest / total) : 0.0);
+    fprintf(fp, "  %-20s %8s %10s\n", "class (block size)", "blocks", "bytes");
+    for (int bin = 0; bin < HIST_BINS; bin++)
+        if (count[bin])
+            fprintf(fp, "  [%7lu, %8lu) %8zu %10zu\n", 1UL << (bin + 4), 1UL << (bin + 5), count[bin], bytes[bin]);
+    fprintf(fp, "list lengths");
+    for (int class = 0; class < NUM_CLASSES; class++) fprintf(fp, " %zu", lengths[class]);
+    fprintf(fp, ", tree %zu blocks, quick bins %u blocks\n", ntree, quick);
+    fprintf(fp, "fit searches %lu, %.2f blocks looked at per search\n", searches, searches ? (double)steps / searches : 0.0);
+    fprintf(fp, "slabs with free slots %zu, %zu of %zu slots free\n", slabs, free_slots, slots);
+}
+
+/*
+ * Returns how many bytes of payload block ptr can hold, at least what was requested
+ */
+size_t mm_usable_size(void *ptr) {
+    if (ptr == NULL) return 0;
+    if (!IN_HEAP(ptr)) return MMAP_LEN(ptr) - MMAP_HDR - MMAP_LEAD(ptr);
+    struct slab *slab = slab_of(ptr);
+    if (slab) return slab->size;
+    return (__atomic_load_n((unsigned int *)HDRP(ptr), __ATOMIC_RELAXED) & ~0x7) - WSIZE;
+}
+
+/*
+ * Returns the bytes block bp takes up: its block, slot or mapping size
+ */
+static size_t block_bytes(void *bp) {
+    struct slab *slab;
+
+    if (!IN_HEAP(bp)) return MMAP_LEN(bp);
+    if ((slab = slab_of(bp)) != NULL) return slab->size;
+    return BLOCK_SIZE(bp);
+}
+
+/*
+ * Adds the per-thread counters of src (possibly being updated by its thread) to dst
+ */
+static void stats_add(struct mm_stats *dst, struct mm_stats *src) {
+    dst->live_bytes += __atomic_load_n(&src->live_bytes, __ATOMIC_RELAXED);
+    dst->mallocs += __atomic_load_n(&src->mallocs, __ATOMIC_RELAXED);
+    dst->frees += __atomic_load_n(&src->frees, __ATOMIC_RELAXED);
+    dst->reallocs += __atomic_load_n(&src->reallocs, __ATOMIC_RELAXED);
+    dst->tcache_hits += __atomic_load_n(&src->tcache_hits, __ATOMIC_RELAXED);
+    for (int i = 0; i < MM_STATS_CLASSES; i++)
+        dst->class_mallocs[i] += __atomic_load_n(&src->class_mallocs[i], __ATOMIC_RELAXED);
+}
+
+/*
+ * Copies the allocator statistics into *st: the global counters plus those of every
+ * thread still running (exited threads' were added to the global ones by tcache_flush)
+ */
+void mm_stats(struct mm_stats *st) {
+    pthread_mutex_lock(&heap_lock);
+    memset(st, 0, sizeof(*st));
+    stats_add(st, &stats);
+    for (struct tcache *tc = tcache_list; tc; tc = tc->next)
+        if (__atomic_load_n(&tc->gen, __ATOMIC_RELAXED) == heap_gen) stats_add(st, &tc->stats);
+    st->heap_bytes = mem_heapsize();
+    st->peak_heap_bytes = stats.peak_heap_bytes;
+    st->mmap_bytes = __atomic_load_n(&stats.mmap_bytes, __ATOMIC_RELAXED);
+    st->sbrk_calls = stats.sbrk_calls;
+    st->coalesce_prev = stats.coalesce_prev;
+    st->coalesce_next = stats.coalesce_next;
+    st->coalesce_both = stats.coalesce_both;
+    st->fit_searches = fit_searches;
+    st->avg_probes = fit_searches ? (double)fit_steps / fit_searches : 0.0;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+#ifdef MM_DEBUG
+/*
+ * Hardened mode wrappers (see the top of the file)
+ */
+#undef mm_malloc
+#undef mm_free
+#undef mm_realloc
+#undef mm_memalign
+#undef mm_calloc
+#undef mm_usable_size
+
+#define DBG_LIVE        0xa110ca7eu         /* dbg_hdr states */
+#define DBG_FREED       0xf4eef4eeu
+#define DBG_CANARY      0xc0decafefeedfaceULL
+#define DBG_ALLOC_BYTE  0xcd                /* fills new payloads (not mm_calloc's) */
+#define DBG_FREED_BYTE  0xdf                /* fills quarantined payloads */
+#define DBG_QUARANTINE  1024                /* freed blocks held back */
+#define DBG_QUARANTINE_BYTES (4 << 20)      /* and at most this many payload bytes of them */
+#define DBG_PAD(align)  (((sizeof(struct dbg_hdr) + (align) - 1) / (align)) * (align))
+
+struct dbg_hdr {
+    void *site;                 // return address of the mm_* call that allocated it
+    void *free_site;            // and of the one that freed it
+    size_t size;                // requested size
+    unsigned int offset;        // payload - start of the underlying block
+    unsigned int state;         // DBG_LIVE or DBG_FREED
+    uint64_t canary;            // DBG_CANARY, right before the payload
+};
+
+__thread void *mm_debug_caller = NULL;     // see mm.h
+static void *dbg_quarantine[DBG_QUARANTINE];
+static int dbg_head = 0, dbg_count = 0;     // FIFO of freed payloads
+static size_t dbg_bytes = 0;                // payload bytes in it
+static pthread_mutex_t dbg_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define DBG(ptr)  ((struct dbg_hdr *)(ptr) - 1)
+#define DBG_SITE() dbg_site(__builtin_return_address(0))
+
+static void *dbg_site(void *ret) {
+    void *site = mm_debug_caller ? mm_debug_caller : ret;
+    mm_debug_caller = NULL;
+    return site;
+}
+
+static void dbg_abort(const char *what, void *ptr, struct dbg_hdr *h, void *site) {
+    fprintf(stderr, "mm: %s of %p at %p", what, ptr, site);
+    if (h) fprintf(stderr, ", block of %zu bytes allocated at %p", h->size, h->site);
+    if (h && h->state == DBG_FREED) fprintf(stderr, ", freed at %p", h->free_site);
+    fprintf(stderr, "\n");
+    abort();
+}
+
+static uint64_t dbg_tail(void *ptr) {
+    uint64_t tail;
+    memcpy(&tail, (char *)ptr + DBG(ptr)->size, sizeof(tail));
+    return tail;
+}
+
+/*
+ * Wraps raw block of a request of size bytes, payload pad bytes into it
+ */
+static void *dbg_init(char *raw, size_t pad, size_t size, void *site) {
+    char *ptr = raw + pad;
+    uint64_t canary = DBG_CANARY;
+
+    if (raw == NULL) return NULL;
+    DBG(ptr)->site = site;
+    DBG(ptr)->free_site = NULL;
+    DBG(ptr)->size = size;
+    DBG(ptr)->offset = pad;
+    DBG(ptr)->state = DBG_LIVE;
+    DBG(ptr)->canary = DBG_CANARY;
+    memcpy(ptr + size, &canary, sizeof(canary));
+    return ptr;
+}
+
+/*
+ * Returns ptr's header after checking that ptr is a live block with intact canaries
+ */
+static struct dbg_hdr *dbg_validate(void *ptr, void *site) {
+    struct dbg_hdr *h = DBG(ptr);
+
+    if ((uintptr_t)ptr % ALIGNMENT) dbg_abort("invalid free (misaligned pointer)", ptr, NULL, site);
+    if (h->state == DBG_FREED) dbg_abort("double free", ptr, h, site);
+    if (h->state != DBG_LIVE) dbg_abort("invalid free (not an allocated block, or its header is overwritten)", ptr, NULL, site);
+    if (h->canary != DBG_CANARY) dbg_abort("buffer underflow", ptr, h, site);
+    if (dbg_tail(ptr) != DBG_CANARY) dbg_abort("buffer overflow", ptr, h, site);
+    return h;
+}
+
+/*
+ * Returns the first byte of quarantined ptr that was written to after it was freed, or NULL
+ */
+static unsigned char *dbg_poison_broken(void *ptr) {
+    unsigned char *p = ptr;
+    for (size_t i = 0; i < DBG(ptr)->size; i++)
+        if (p[i] != DBG_FREED_BYTE) return p + i;
+    return NULL;
+}
+
+void *mm_malloc(size_t size) {
+    void *site = DBG_SITE();
+    size_t pad = DBG_PAD(ALIGNMENT);
+    if (size + pad + sizeof(uint64_t) < size) return NULL;
+    char *ptr = dbg_init(mm_malloc_raw(size + pad + sizeof(uint64_t)), pad, size, site);
+    if (ptr) memset(ptr, DBG_ALLOC_BYTE, size);
+    return ptr;
+}
+
+void *mm_memalign(size_t alignment, size_t size) {
+    void *site = DBG_SITE();
+    size_t pad = DBG_PAD(MAX(alignment, ALIGNMENT));
+    if (size + pad + sizeof(uint64_t) < size) return NULL;
+    char *ptr = dbg_init(mm_memalign_raw(alignment, size + pad + sizeof(uint64_t)), pad, size, site);
+    if (ptr) memset(ptr, DBG_ALLOC_BYTE, size);
+    return ptr;
+}
+
+void *mm_calloc(size_t nmemb, size_t size) {
+    void *site = DBG_SITE();
+    size_t bytes, pad = DBG_PAD(ALIGNMENT);
+    if (__builtin_mul_overflow(nmemb, size, &bytes) || bytes + pad + sizeof(uint64_t) < bytes) return NULL;
+    return dbg_init(mm_calloc_raw(1, bytes + pad + sizeof(uint64_t)), pad, bytes, site);
+}
+
+/*
+ * Checks ptr and quarantines it, really freeing the oldest quarantined block if full
+ */
+void mm_free(void *ptr) {
+    void *site = DBG_SITE();
+    unsigned char *broken;
+
+    if (ptr == NULL) return;
+    pthread_mutex_lock(&dbg_lock);      // also orders the state checks of racing frees
+    struct dbg_hdr *h = dbg_validate(ptr, site);
+    h->state = DBG_FREED;
+    h->free_site = site;
+    memset(ptr, DBG_FREED_BYTE, h->size);
+
+    // make room, oldest first (dbg_lock is taken before heap_lock, never the other way)
+    while (dbg_count == DBG_QUARANTINE || (dbg_count && dbg_bytes + h->size > DBG_QUARANTINE_BYTES)) {
+        void *old = dbg_quarantine[dbg_head];
+        dbg_head = (dbg_head + 1) % DBG_QUARANTINE;
+        dbg_count--;
+        if (DBG(old)->state != DBG_FREED)
+            dbg_abort("write after free (over its header)", old, NULL, NULL);
+        if ((broken = dbg_poison_broken(old)) != NULL)
+            dbg_abort("write after free", broken, DBG(old), DBG(old)->free_site);
+        dbg_bytes -= DBG(old)->size;
+        mm_free_raw((char *)old - DBG(old)->offset);
+    }
+    dbg_quarantine[(dbg_head + dbg_count++) % DBG_QUARANTINE] = ptr;
+    dbg_bytes += h->size;
+    pthread_mutex_unlock(&dbg_lock);
+}
+
+void *mm_realloc(void *ptr, size_t size) {
+    void *site = DBG_SITE();
+
+    if (ptr == NULL) {
+        mm_debug_caller = site;
+        return mm_malloc(size);
+    }
+    mm_debug_caller = site;
+    if (size == 0) {
+        mm_free(ptr);
+        return NULL;
+    }
+    pthread_mutex_lock(&dbg_lock);
+    struct dbg_hdr *h = dbg_validate(ptr, site);
+    pthread_mutex_unlock(&dbg_lock);
+
+    void *newptr = mm_malloc(size);    // always moves, so stale pointers to the old block are caught
+    if (newptr == NULL) return NULL;
+    memcpy(newptr, ptr, MIN(size, h->size));
+    mm_debug_caller = site;
+    mm_free(ptr);
+    return newptr;
+}
+
+size_t mm_usable_size(void *ptr) {
+    return ptr ? DBG(ptr)->size : 0;
+}
+
+static void dbg_reset(void) {
+    pthread_mutex_lock(&dbg_lock);
+    dbg_head = dbg_count = 0;
+    dbg_bytes = 0;
+    pthread_mutex_unlock(&dbg_lock);
+}
+
+/*
+ * Checks the poison of every quarantined block, returns the number of broken ones
+ */
+static int dbg_check(void) {
+    int errors = 0;
+    unsigned char *broken;
+
+    pthread_mutex_lock(&dbg_lock);
+    for (int i = 0; i < dbg_count; i++) {
+        void *ptr = dbg_quarantine[(dbg_head + i) % DBG_QUARANTINE];
+        if (DBG(ptr)->state != DBG_FREED)
+            HEAP_ERR("%p: header overwritten after it was freed\n", ptr);
+        else if ((broken = dbg_poison_broken(ptr)) != NULL)
+            HEAP_ERR("%p: written at %p after it was freed at %p\n", ptr, (void *)broken, DBG(ptr)->free_site);
+    }
+    pthread_mutex_unlock(&dbg_lock);
+    return errors;
+}
+#endif
@@ -0,0 +1,57 @@
+/*
+ * mm.h - interface of the mm.c allocator
+ */
+#ifndef __MM_H__
+#define __MM_H__
+
+#include <stdio.h>
+
+extern int mm_init (void);
+extern void *mm_malloc (size_t size);
+extern void mm_free (void *ptr);
+extern void *mm_realloc(void *ptr, size_t size);
+
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+extern size_t mm_usable_size(void *ptr);
+
+#ifdef MM_DEBUG
+/* hardened mode: a wrapper around mm_* sets this to its caller, to be reported as the site */
+extern __thread void *mm_debug_caller;
+#endif
+
+/* debugging and profiling */
+extern int mm_check(int verbose);
+extern void mm_profile(FILE *fp);
+
+#define MM_STATS_CLASSES 28     /* block size classes [2^(k+4), 2^(k+5)) */
+
+/* counters kept by the allocator, see mm_stats */
+struct mm_stats {
+    size_t live_bytes;          /* bytes in blocks handed out (block, slot or mapping size) */
+    size_t heap_bytes;          /* current sbrk heap size */
+    size_t peak_heap_bytes;     /* largest sbrk heap size */
+    size_t mmap_bytes;          /* bytes in separately mapped blocks */
+    unsigned long mallocs, frees, reallocs;
+    unsigned long class_mallocs[MM_STATS_CLASSES];  /* mallocs by block size class */
+    unsigned long tcache_hits;  /* mallocs served by the thread cache */
+    unsigned long sbrk_calls;   /* heap extensions and trims */
+    unsigned long fit_searches; /* free list/tree searches */
+    unsigned long coalesce_prev, coalesce_next, coalesce_both;  /* merges by neighbour */
+    double avg_probes;          /* free blocks looked at per search */
+};
+
+extern void mm_stats(struct mm_stats *st);
+
+/* 
+ * Students work in teams of one. Fill in the team struct in mm.c
+ */
+typedef struct {
+    char *id;           /* Student ID */
+    char *name;         /* Full name */
+    char *email;        /* Email address */
+} team_t;
+
+extern team_t team;
+
+#endif /* __MM_H__ */
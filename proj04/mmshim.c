@@ -0,0 +1,165 @@
+/*
+ * mmshim.c - the C library allocator interface on top of mm.c
+ *
+ * Built into libmm.so (make libmm.so) together with mm.c and a memlib.c
+ * that doesn't track its mappings, so that real programs can run on the
+ * allocator through LD_PRELOAD, e.g.
+ *
+ *   LD_PRELOAD=$PWD/libmm.so ../proj03/project3/task2/stockserver 60001
+ *   LD_PRELOAD=$PWD/libmm.so ../proj02/20201572/phase3/myshell
+ *
+ * and be compared with the same run on the glibc allocator. The libc entry
+ * points that allocate on their own (reallocarray, valloc, ...) are replaced
+ * as well, or glibc would be handed mm.c blocks to free. The heap is
+ * set up on the first call (the dynamic loader and libc allocate before
+ * any constructor runs). MM_POLICY and MM_DEFER are honored as usual.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* hardened mode (libmm-debug.so): report our caller, not us, as allocation/free site */
+#ifdef MM_DEBUG
+#define SHIM_CALLER() do { if (!mm_debug_caller) mm_debug_caller = __builtin_return_address(0); } while (0)
+#else
+#define SHIM_CALLER()
+#endif
+
+static pthread_once_t shim_once = PTHREAD_ONCE_INIT;
+static int shim_ready = 0;
+
+static void shim_init(void)
+{
+    mem_init();
+    if (mm_init() < 0)
+        abort();
+    __atomic_store_n(&shim_ready, 1, __ATOMIC_RELEASE);
+}
+
+static inline void shim_check_init(void)
+{
+    if (!__atomic_load_n(&shim_ready, __ATOMIC_ACQUIRE))
+        pthread_once(&shim_once, shim_init);
+}
+
+void *malloc(size_t size)
+{
+    void *p;
+
+    shim_check_init();
+    SHIM_CALLER();
+    if ((p = mm_malloc(size ? size : 1)) == NULL)   /* malloc(0) is a unique pointer */
+        errno = ENOMEM;
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    shim_check_init();
+    SHIM_CALLER();
+    mm_free(ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL) {
+        SHIM_CALLER();
+        return malloc(size);
+    }    /* including size 0, which mm_realloc would treat as free */
+    shim_check_init();
+    SHIM_CALLER();
+    if ((p = mm_realloc(ptr, size)) == NULL && size)
+        errno = ENOMEM;
+    return p;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *p;
+
+    shim_check_init();
+    SHIM_CALLER();
+    if (nmemb == 0 || size == 0)    /* a unique pointer, like malloc(0) */
+        nmemb = size = 1;
+    if ((p = mm_calloc(nmemb, size)) == NULL)
+        errno = ENOMEM;
+    return p;
+}
+
+/* glibc's own reallocarray calls its internal realloc, so it has to be replaced too */
+void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    size_t bytes;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    SHIM_CALLER();
+    return realloc(ptr, bytes);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+        return EINVAL;
+    shim_check_init();
+    SHIM_CALLER();
+    if ((p = mm_memalign(alignment, size ? size : 1)) == NULL)
+        return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    void *p;
+    int err;
+
+    if (alignment < sizeof(void *))
+        alignment = sizeof(void *);
+    SHIM_CALLER();
+    if ((err = posix_memalign(&p, alignment, size)) != 0) {
+        errno = err;
+        return NULL;
+    }
+    return p;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    SHIM_CALLER();
+    return aligned_alloc(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    SHIM_CALLER();
+    return aligned_alloc(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+    SHIM_CALLER();
+    return aligned_alloc(page, size > PTRDIFF_MAX ? size : (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    shim_check_init();
+    return mm_usable_size(ptr);
+}
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+gen_traces.py - regenerates the sample allocator traces in this directory
+
+Trace format (same as the CS:APP malloc lab):
+    <suggested heap size>
+    <number of block ids>
+    <number of ops>
+    <weight>
+    a <id> <bytes>      malloc
+    r <id> <bytes>      realloc
+    f <id>              free
+Every id is allocated once and freed at most once.
+"""
+import random
+
+
+def write(name, ops, nids):
+    with open(name, "w") as f:
+        f.write("%d\n%d\n%d\n1\n" % (20 * (1 << 20), nids, len(ops)))
+        for op in ops:
+            f.write(" ".join(str(x) for x in op) + "\n")
+
+
+def random_trace(rng, nids, lo, hi):
+    """allocs and frees of random sizes in random order"""
+    ops, live, nxt = [], [], 0
+    while nxt < nids or live:
+        if nxt < nids and (not live or rng.random() < 0.6):
+            ops.append(("a", nxt, rng.randint(lo, hi)))
+            live.append(nxt)
+            nxt += 1
+        else:
+            ops.append(("f", live.pop(rng.randrange(len(live)))))
+    return ops
+
+
+def binary_trace(rng, n):
+    """alternating small/large blocks, all large ones freed, then larger requests"""
+    ops = []
+    for i in range(n):
+        ops.append(("a", 2 * i, 64))
+        ops.append(("a", 2 * i + 1, 448))
+    for i in range(n):
+        ops.append(("f", 2 * i + 1))
+    for i in range(n):
+        ops.append(("a", 2 * n + i, 512))
+    for i in range(n):
+        ops.append(("f", 2 * i))
+        ops.append(("f", 2 * n + i))
+    return ops, 3 * n
+
+
+def coalescing_trace(n):
+    """pairs allocated and freed so that every free merges with a neighbour"""
+    ops = []
+    for i in range(n):
+        ops.append(("a", 2 * i, 4095))
+        ops.append(("a", 2 * i + 1, 4095))
+        ops.append(("f", 2 * i))
+        ops.append(("f", 2 * i + 1))
+    return ops, 2 * n
+
+
+def realloc_trace(rng, n):
+    """two buffers grown step by step with small allocations in between"""
+    ops = [("a", 0, 512), ("a", 1, 128)]
+    for i in range(n):
+        ops.append(("r", 0, 512 + 128 * (i + 1)))
+        ops.append(("r", 1, 128 + 128 * (i + 1)))
+        ops.append(("a", 2 + i, 16))
+    ops.append(("f", 0))
+    ops.append(("f", 1))
+    for i in range(n):
+        ops.append(("f", 2 + i))
+    return ops, n + 2
+
+
+def small_trace(rng, nids):
+    """churn of small objects (8 to 128 bytes), FIFO-ish lifetimes"""
+    ops, live, nxt = [], [], 0
+    while nxt < nids or live:
+        if nxt < nids and (len(live) < 512 or rng.random() < 0.5):
+            ops.append(("a", nxt, rng.choice((8, 16, 24, 32, 48, 64, 96, 128))))
+            live.append(nxt)
+            nxt += 1
+        else:
+            ops.append(("f", live.pop(rng.randrange(min(len(live), 64)))))
+    return ops
+
+
+def fragment_trace(rng, nids):
+    """long-lived random survivors build up a large fragmented free list"""
+    ops, live, nxt = [], [], 0
+    while nxt < nids:
+        ops.append(("a", nxt, rng.randint(16, 2048)))
+        live.append(nxt)
+        nxt += 1
+        if len(live) > 64 and rng.random() < 0.55:
+            ops.append(("f", live.pop(rng.randrange(len(live)))))
+    for i in live:
+        ops.append(("f", i))
+    return ops
+
+
+def large_trace(rng, nids):
+    """large buffers (64KB to 2MB) mixed with small blocks, most large ones short-lived"""
+    ops, live, nxt = [], [], 0
+    while nxt < nids or live:
+        if nxt < nids and (not live or rng.random() < 0.55):
+            big = rng.random() < 0.2
+            ops.append(("a", nxt, rng.randint(65536, 2 << 20) if big else rng.randint(16, 4096)))
+            live.append(nxt)
+            nxt += 1
+        else:
+            ops.append(("f", live.pop(rng.randrange(len(live)))))
+    return ops
+
+
+if __name__ == "__main__":
+    rng = random.Random(4100)
+    write("random.rep", random_trace(rng, 2400, 1, 16384), 2400)
+    write("random-small.rep", random_trace(rng, 2400, 1, 512), 2400)
+    ops, n = binary_trace(rng, 1000)
+    write("binary.rep", ops, n)
+    ops, n = coalescing_trace(1200)
+    write("coalescing.rep", ops, n)
+    ops, n = realloc_trace(rng, 1600)
+    write("realloc.rep", ops, n)
+    write("small.rep", small_trace(rng, 4000), 4000)
+    write("fragment.rep", fragment_trace(rng, 4000), 4000)
+    write("large.rep", large_trace(random.Random(4101), 1200), 1200)